@@ -0,0 +1,348 @@
+// Timing, statistics and reporting shared by the benchmarks
+#ifndef SPATIAL_LIB_BENCHMARK_HPP_
+#define SPATIAL_LIB_BENCHMARK_HPP_
+
+#include "./perf_counters.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+namespace spatial_lib_benchmark {
+
+struct Options {
+	std::size_t repetitions = 10;
+	std::size_t warmup = 2;
+	std::size_t points = 1000000;
+	std::size_t queries = 10000;
+	/// Negative leaves the thread unpinned
+	int cpu = 0;
+	/// Where to write the JSON report, nothing is written when empty
+	std::string json;
+	/// Only benchmarks whose name contains this run
+	std::string filter;
+	/// Only datasets whose name contains this run
+	std::string dataset;
+	/// A point file from write_points to run as the dataset "file"
+	std::string load;
+	/// Whether to read hardware counters alongside the timings
+	bool counters = true;
+
+	static constexpr std::string_view usage =
+		"Options:\n"
+		"  --repetitions N  timed runs of each benchmark (10)\n"
+		"  --warmup N       untimed runs before them (2)\n"
+		"  --points N       points in each tree (1000000)\n"
+		"  --queries N      queries per run (10000)\n"
+		"  --cpu N          cpu to pin to, -1 for none (0)\n"
+		"  --json FILE      also write the results as JSON to FILE\n"
+		"  --filter TEXT    only run benchmarks whose name contains TEXT\n"
+		"  --dataset TEXT   only run datasets whose name contains TEXT, out of uniform,\n"
+		"                   clustered, duplicates, embedded, roads, line and file\n"
+		"  --load FILE      also run on the points in FILE, written by write_points\n"
+		"  --counters N     0 to skip reading hardware counters (1)\n";
+
+	/// Throws std::invalid_argument on anything it doesn't understand
+	static Options parse( const std::vector<std::string>& arguments ) {
+		Options options;
+		for ( std::size_t i = 0; i < arguments.size(); i++ ) {
+			const std::string& flag = arguments[i];
+			if ( i + 1 == arguments.size() ) {
+				throw std::invalid_argument( "Missing value for " + flag );
+			}
+			const std::string& value = arguments[++i];
+			if ( flag == "--repetitions" ) {
+				options.repetitions = std::max<std::size_t>( 1, std::stoul( value ) );
+			} else if ( flag == "--warmup" ) {
+				options.warmup = std::stoul( value );
+			} else if ( flag == "--points" ) {
+				options.points = std::max<std::size_t>( 1, std::stoul( value ) );
+			} else if ( flag == "--queries" ) {
+				options.queries = std::max<std::size_t>( 1, std::stoul( value ) );
+			} else if ( flag == "--cpu" ) {
+				options.cpu = std::stoi( value );
+			} else if ( flag == "--json" ) {
+				options.json = value;
+			} else if ( flag == "--filter" ) {
+				options.filter = value;
+			} else if ( flag == "--dataset" ) {
+				options.dataset = value;
+			} else if ( flag == "--load" ) {
+				options.load = value;
+			} else if ( flag == "--counters" ) {
+				options.counters = std::stoi( value ) != 0;
+			} else {
+				throw std::invalid_argument( "Unknown option " + flag );
+			}
+		}
+		return options;
+	}
+
+	bool selected( const std::string& name ) const {
+		return filter.empty() || name.find( filter ) != std::string::npos;
+	}
+
+	bool selected_dataset( const std::string& name ) const {
+		return dataset.empty() || name.find( dataset ) != std::string::npos;
+	}
+};
+
+/// Keeps the calling thread on cpu, so the scheduler can't move it between caches mid run.
+/// Returns false where that isn't supported or allowed.
+inline bool pin_to_cpu( const int cpu ) {
+#ifdef __linux__
+	if ( cpu < 0 ) {
+		return false;
+	}
+	cpu_set_t set;
+	CPU_ZERO( &set );
+	CPU_SET( static_cast<std::size_t>( cpu ), &set );
+	return sched_setaffinity( 0, sizeof( set ), &set ) == 0;
+#else
+	static_cast<void>( cpu );
+	return false;
+#endif
+}
+
+/// Stops the optimizer from dropping a result that is otherwise unused
+template <typename T> void do_not_optimize( const T& value ) {
+	asm volatile( "" : : "r,m"( value ) : "memory" );
+}
+
+/// Also counts function on counters when given, outside of the timing
+template <typename Function>
+double time_ns( Function&& function, const PerfCounters* const counters = nullptr ) {
+	if ( counters != nullptr ) {
+		counters->start();
+	}
+	const auto start = std::chrono::steady_clock::now();
+	function();
+	const auto end = std::chrono::steady_clock::now();
+	if ( counters != nullptr ) {
+		counters->stop();
+	}
+	return std::chrono::duration<double, std::nano>( end - start ).count();
+}
+
+/// Calls run, which returns its own timing, options.warmup times untimed then
+/// options.repetitions times, returning the timed samples. counters are reset after the warmup,
+/// so whatever run counts on them covers only the timed runs.
+template <typename Run>
+std::vector<double> repeat(
+	const Options& options, Run&& run, PerfCounters* const counters = nullptr
+) {
+	for ( std::size_t i = 0; i < options.warmup; i++ ) {
+		run();
+	}
+	if ( counters != nullptr ) {
+		counters->reset();
+	}
+	std::vector<double> samples;
+	samples.reserve( options.repetitions );
+	for ( std::size_t i = 0; i < options.repetitions; i++ ) {
+		samples.push_back( run() );
+	}
+	return samples;
+}
+
+/// Times query( i ) for every i below count on its own, after options.warmup untimed passes,
+/// for options.repetitions passes. Per query samples give real tail percentiles, at the cost of
+/// the clock's own overhead of a few tens of nanoseconds in each. Given counters, one more
+/// untimed pass runs while they count, so they hold a pass free of the clock's instructions.
+template <typename Query>
+std::vector<double> time_each_query(
+	const Options& options,
+	const std::size_t count,
+	Query&& query,
+	PerfCounters* const counters = nullptr
+) {
+	for ( std::size_t pass = 0; pass < options.warmup; pass++ ) {
+		for ( std::size_t i = 0; i < count; i++ ) {
+			query( i );
+		}
+	}
+	std::vector<double> samples;
+	samples.reserve( count * options.repetitions );
+	for ( std::size_t pass = 0; pass < options.repetitions; pass++ ) {
+		for ( std::size_t i = 0; i < count; i++ ) {
+			samples.push_back( time_ns( [&] { query( i ); } ) );
+		}
+	}
+	if ( counters != nullptr ) {
+		counters->reset();
+		counters->start();
+		for ( std::size_t i = 0; i < count; i++ ) {
+			query( i );
+		}
+		counters->stop();
+	}
+	return samples;
+}
+
+struct Summary {
+	std::size_t samples = 0;
+	double min = 0;
+	double median = 0;
+	/// Median absolute deviation from the median, a spread that ignores outliers
+	double mad = 0;
+	double p90 = 0;
+	double p99 = 0;
+	double max = 0;
+	double mean = 0;
+};
+
+/// Linearly interpolated, fraction in [0, 1] of a sorted sample
+inline double percentile( const std::vector<double>& sorted, const double fraction ) {
+	if ( sorted.empty() ) {
+		return 0;
+	}
+	const double position = fraction * static_cast<double>( sorted.size() - 1 );
+	const auto below = static_cast<std::size_t>( position );
+	const std::size_t above = std::min( below + 1, sorted.size() - 1 );
+	const double weight = position - static_cast<double>( below );
+	return ( sorted[below] * ( 1 - weight ) ) + ( sorted[above] * weight );
+}
+
+inline Summary summarize( std::vector<double> samples ) {
+	Summary summary;
+	if ( samples.empty() ) {
+		return summary;
+	}
+	std::sort( samples.begin(), samples.end() );
+	summary.samples = samples.size();
+	summary.min = samples.front();
+	summary.max = samples.back();
+	summary.median = percentile( samples, 0.5 );
+	summary.p90 = percentile( samples, 0.9 );
+	summary.p99 = percentile( samples, 0.99 );
+	summary.mean = std::accumulate( samples.begin(), samples.end(), 0.0 ) /
+		static_cast<double>( samples.size() );
+	for ( double& sample : samples ) {
+		sample = std::abs( sample - summary.median );
+	}
+	std::sort( samples.begin(), samples.end() );
+	summary.mad = percentile( samples, 0.5 );
+	return summary;
+}
+
+struct Result {
+	std::string name;
+	std::string dataset;
+	std::size_t points = 0;
+	/// What one sample measures, such as "ns/query"
+	std::string unit;
+	Summary summary;
+	/// Anything else worth keeping with the timings, such as results per query
+	std::vector<std::pair<std::string, double>> counters;
+};
+
+class Report {
+	std::vector<Result> results;
+
+	static std::string quoted( const std::string& text ) {
+		std::string escaped = "\"";
+		for ( const char character : text ) {
+			if ( character == '"' || character == '\\' ) {
+				escaped += '\\';
+			}
+			escaped += character;
+		}
+		return escaped + '"';
+	}
+
+	/// JSON has no NaN or infinity, such as the IPC of a run that counted no cycles, so they're
+	/// written as null
+	static std::string number( const double value ) {
+		if ( !std::isfinite( value ) ) {
+			return "null";
+		}
+		std::ostringstream text;
+		text << std::setprecision( 17 ) << value;
+		return text.str();
+	}
+
+	public:
+	/// Adds result and prints it as one row of the table
+	void add( Result result, std::ostream& table ) {
+		const Summary& summary = result.summary;
+		table << std::left << std::setw( 28 ) << result.name << std::setw( 12 ) << result.dataset
+			  << std::right << std::fixed << std::setprecision( 1 );
+		for ( const double value : { summary.median,
+									 summary.mad,
+									 summary.p90,
+									 summary.p99,
+									 summary.min,
+									 summary.max } ) {
+			table << std::setw( 12 ) << value;
+		}
+		table << "  " << result.unit;
+		for ( const auto& [name, value] : result.counters ) {
+			table << "  " << name << '=' << value;
+		}
+		table << '\n' << std::flush;
+		results.push_back( std::move( result ) );
+	}
+
+	static void print_header( std::ostream& table ) {
+		table << std::left << std::setw( 28 ) << "benchmark" << std::setw( 12 ) << "dataset"
+			  << std::right;
+		for ( const char* column : { "median", "MAD", "p90", "p99", "min", "max" } ) {
+			table << std::setw( 12 ) << column;
+		}
+		table << '\n';
+	}
+
+	/// counted is whether hardware counters were read, their absence in a result then means the
+	/// event wasn't available rather than turned off
+	void write_json(
+		std::ostream& json, const Options& options, const bool pinned, const bool counted
+	) const {
+		json << std::setprecision( 17 ) << "{\n"
+			 << "  \"options\": {\"repetitions\": " << options.repetitions
+			 << ", \"warmup\": " << options.warmup << ", \"points\": " << options.points
+			 << ", \"queries\": " << options.queries << ", \"cpu\": " << options.cpu
+			 << ", \"pinned\": " << ( pinned ? "true" : "false" )
+			 << ", \"hardware_counters\": " << ( counted ? "true" : "false" ) << "},\n"
+			 << "  \"results\": [";
+		for ( std::size_t i = 0; i < results.size(); i++ ) {
+			const Result& result = results[i];
+			const Summary& summary = result.summary;
+			json << ( i == 0 ? "\n" : ",\n" ) << "    {\"name\": " << quoted( result.name )
+				 << ", \"dataset\": " << quoted( result.dataset )
+				 << ", \"points\": " << result.points
+				 << ", \"unit\": " << quoted( result.unit ) << ", \"samples\": " << summary.samples
+				 << ", \"median\": " << number( summary.median )
+				 << ", \"mad\": " << number( summary.mad ) << ", \"p90\": " << number( summary.p90 )
+				 << ", \"p99\": " << number( summary.p99 ) << ", \"min\": " << number( summary.min )
+				 << ", \"max\": " << number( summary.max )
+				 << ", \"mean\": " << number( summary.mean ) << ", \"counters\": {";
+			for ( std::size_t j = 0; j < result.counters.size(); j++ ) {
+				json << ( j == 0 ? "" : ", " ) << quoted( result.counters[j].first ) << ": "
+					 << number( result.counters[j].second );
+			}
+			json << "}}";
+		}
+		json << "\n  ]\n}\n";
+	}
+};
+
+}  // namespace spatial_lib_benchmark
+
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+#endif
@@ -0,0 +1,290 @@
+// Synthetic datasets for the benchmarks, and a binary point file format for replaying real ones
+#ifndef SPATIAL_LIB_BENCHMARK_DATASETS_HPP_
+#define SPATIAL_LIB_BENCHMARK_DATASETS_HPP_
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+namespace spatial_lib_benchmark {
+
+template <std::size_t Dimensions> struct Point {
+	std::array<double, Dimensions> coordinates;
+	std::uint32_t id;
+};
+
+/// Points from a file, whose dimensions are only known once it's read
+struct DynamicPoint {
+	std::vector<double> coordinates;
+	std::uint32_t id;
+};
+
+/// Integer coordinates in a C array, the one layout every experiment tree in expirements/kd_tree
+/// takes
+template <std::size_t Dimensions> struct IntegerPoint {
+	std::int32_t coordinates[Dimensions];  // NOLINT(cppcoreguidelines-avoid-c-arrays)
+	std::uint32_t id;
+};
+
+/// Uniform in a cube of side 2000 around the origin, the easy case
+template <std::size_t Dimensions>
+std::vector<Point<Dimensions>> uniform_points( const std::size_t count, const unsigned int seed ) {
+	std::mt19937 generator( seed );
+	std::uniform_real_distribution<double> uniform( -1000.0, 1000.0 );
+	std::vector<Point<Dimensions>> points( count );
+	for ( std::size_t i = 0; i < count; i++ ) {
+		for ( double& coordinate : points[i].coordinates ) {
+			coordinate = uniform( generator );
+		}
+		points[i].id = static_cast<std::uint32_t>( i );
+	}
+	return points;
+}
+
+/// Tight gaussian blobs around uniform centers, leaving most of each cell empty
+template <std::size_t Dimensions>
+std::vector<Point<Dimensions>> clustered_points(
+	const std::size_t count,
+	const std::size_t clusters,
+	const double spread,
+	const unsigned int seed
+) {
+	std::mt19937 generator( seed );
+	const std::vector<Point<Dimensions>> centers = uniform_points<Dimensions>( clusters, seed + 1 );
+	std::normal_distribution<double> offset( 0.0, spread );
+	std::vector<Point<Dimensions>> points( count );
+	for ( std::size_t i = 0; i < count; i++ ) {
+		points[i] = { centers[i % clusters].coordinates, static_cast<std::uint32_t>( i ) };
+		for ( double& coordinate : points[i].coordinates ) {
+			coordinate += offset( generator );
+		}
+	}
+	return points;
+}
+
+/// Every point is an exact copy of one of distinct locations, and half of them share the
+/// hottest 1% of those, like repeated check ins or snapped GPS fixes. Splits land on long runs
+/// of equal coordinates.
+template <std::size_t Dimensions>
+std::vector<Point<Dimensions>> duplicate_points(
+	const std::size_t count, const std::size_t distinct, const unsigned int seed
+) {
+	std::mt19937 generator( seed );
+	const std::vector<Point<Dimensions>> locations =
+		uniform_points<Dimensions>( distinct, seed + 1 );
+	const std::size_t hottest = std::max<std::size_t>( distinct / 100, 1 );
+	std::uniform_int_distribution<std::size_t> any( 0, distinct - 1 );
+	std::uniform_int_distribution<std::size_t> hot( 0, hottest - 1 );
+	std::bernoulli_distribution pick_hot( 0.5 );
+	std::vector<Point<Dimensions>> points( count );
+	for ( std::size_t i = 0; i < count; i++ ) {
+		const std::size_t location = pick_hot( generator ) ? hot( generator ) : any( generator );
+		points[i] = { locations[location].coordinates, static_cast<std::uint32_t>( i ) };
+	}
+	return points;
+}
+
+/// A curved Intrinsic dimensional sheet in Dimensions, a random linear map of uniform
+/// parameters bent by a sine of another, plus a little noise. Like most embeddings the data
+/// only fills a thin slice of its bounding box.
+template <std::size_t Intrinsic, std::size_t Dimensions>
+std::vector<Point<Dimensions>> embedded_points( const std::size_t count, const unsigned int seed ) {
+	std::mt19937 generator( seed );
+	const double scale = 1.0 / std::sqrt( static_cast<double>( Intrinsic ) );
+	std::normal_distribution<double> weight( 0.0, scale );
+	std::array<std::array<double, Intrinsic>, Dimensions> linear;
+	std::array<std::array<double, Intrinsic>, Dimensions> bend;
+	for ( std::size_t dim = 0; dim < Dimensions; dim++ ) {
+		for ( std::size_t axis = 0; axis < Intrinsic; axis++ ) {
+			linear[dim][axis] = weight( generator );
+			bend[dim][axis] = 2 * weight( generator );
+		}
+	}
+	std::uniform_real_distribution<double> parameter( -1.0, 1.0 );
+	std::normal_distribution<double> noise( 0.0, 0.001 );
+	std::vector<Point<Dimensions>> points( count );
+	for ( std::size_t i = 0; i < count; i++ ) {
+		std::array<double, Intrinsic> u;
+		for ( double& value : u ) {
+			value = parameter( generator );
+		}
+		for ( std::size_t dim = 0; dim < Dimensions; dim++ ) {
+			double straight = 0;
+			double curved = 0;
+			for ( std::size_t axis = 0; axis < Intrinsic; axis++ ) {
+				straight += linear[dim][axis] * u[axis];
+				curved += bend[dim][axis] * u[axis];
+			}
+			points[i].coordinates[dim] =
+				1000 * ( straight + ( 0.3 * std::sin( curved ) ) + noise( generator ) );
+		}
+		points[i].id = static_cast<std::uint32_t>( i );
+	}
+	return points;
+}
+
+/// Points strung along the roads of a planar network, dense in towns and sparse between them.
+/// Intersections cluster around towns and each is joined to its 3 nearest, then points are
+/// dropped along random roads with a meter or so of GPS jitter.
+inline std::vector<Point<2>> road_network_points(
+	const std::size_t count, const unsigned int seed
+) {
+	std::mt19937 generator( seed );
+	const std::vector<Point<2>> towns = uniform_points<2>( 30, seed + 1 );
+	std::normal_distribution<double> around_town( 0.0, 60.0 );
+	std::vector<std::array<double, 2>> intersections( 3000 );
+	for ( std::size_t i = 0; i < intersections.size(); i++ ) {
+		intersections[i] = towns[i % towns.size()].coordinates;
+		for ( double& coordinate : intersections[i] ) {
+			coordinate += around_town( generator );
+		}
+	}
+	auto squared_distance = []( const std::array<double, 2>& a, const std::array<double, 2>& b ) {
+		return ( ( a[0] - b[0] ) * ( a[0] - b[0] ) ) + ( ( a[1] - b[1] ) * ( a[1] - b[1] ) );
+	};
+	std::vector<std::pair<std::size_t, std::size_t>> roads;
+	for ( std::size_t i = 0; i < intersections.size(); i++ ) {
+		std::vector<std::pair<double, std::size_t>> nearest;
+		for ( std::size_t j = 0; j < intersections.size(); j++ ) {
+			if ( j != i ) {
+				nearest.emplace_back( squared_distance( intersections[i], intersections[j] ), j );
+			}
+		}
+		std::partial_sort( nearest.begin(), nearest.begin() + 3, nearest.end() );
+		for ( std::size_t j = 0; j < 3; j++ ) {
+			roads.emplace_back( i, nearest[j].second );
+		}
+	}
+	// highways from an intersection of each town to one of the next
+	for ( std::size_t town = 0; town + 1 < towns.size(); town++ ) {
+		roads.emplace_back( town, town + 1 );
+	}
+
+	std::uniform_int_distribution<std::size_t> pick_road( 0, roads.size() - 1 );
+	std::uniform_real_distribution<double> along( 0.0, 1.0 );
+	std::normal_distribution<double> jitter( 0.0, 1.0 );
+	std::vector<Point<2>> points( count );
+	for ( std::size_t i = 0; i < count; i++ ) {
+		const auto& [from, to] = roads[pick_road( generator )];
+		const double t = along( generator );
+		for ( std::size_t dim = 0; dim < 2; dim++ ) {
+			points[i].coordinates[dim] = intersections[from][dim] +
+				( t * ( intersections[to][dim] - intersections[from][dim] ) ) + jitter( generator );
+		}
+		points[i].id = static_cast<std::uint32_t>( i );
+	}
+	return points;
+}
+
+/// The i-th point is i times 1, 2, 3 and so on up the dimensions, in a shuffled order. Every
+/// dimension sorts the points the same way, the one case the presorted linking of the
+/// experiment trees gets right.
+template <std::size_t Dimensions>
+std::vector<IntegerPoint<Dimensions>> line_points(
+	const std::size_t count, const unsigned int seed
+) {
+	std::vector<IntegerPoint<Dimensions>> points( count );
+	for ( std::size_t i = 0; i < count; i++ ) {
+		for ( std::size_t dim = 0; dim < Dimensions; dim++ ) {
+			points[i].coordinates[dim] = static_cast<std::int32_t>( ( dim + 1 ) * i );
+		}
+		points[i].id = static_cast<std::uint32_t>( i );
+	}
+	std::shuffle( points.begin(), points.end(), std::mt19937( seed ) );
+	return points;
+}
+
+/// value with its bytes reversed on big endian hosts, so between native and little endian
+/// order either way
+template <typename T> T little_endian( const T value ) {
+	if constexpr ( std::endian::native == std::endian::big ) {
+		auto bytes = std::bit_cast<std::array<char, sizeof( T )>>( value );
+		std::reverse( bytes.begin(), bytes.end() );
+		return std::bit_cast<T>( bytes );
+	} else {
+		return value;
+	}
+}
+
+// NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+
+/// Point files are a little endian std::uint64_t point count and std::uint64_t dimensions,
+/// followed by every point's coordinates in turn as little endian doubles.
+template <typename Points> void write_points( const std::string& path, const Points& points ) {
+	std::ofstream file( path, std::ios::binary );
+	const std::uint64_t count = little_endian<std::uint64_t>( points.size() );
+	const std::uint64_t dimensions = little_endian<std::uint64_t>(
+		points.empty() ? 0 : std::size( points.front().coordinates )
+	);
+	file.write( reinterpret_cast<const char*>( &count ), sizeof( count ) );
+	file.write( reinterpret_cast<const char*>( &dimensions ), sizeof( dimensions ) );
+	for ( const auto& point : points ) {
+		for ( const double coordinate : point.coordinates ) {
+			const double stored = little_endian( coordinate );
+			file.write( reinterpret_cast<const char*>( &stored ), sizeof( stored ) );
+		}
+	}
+	if ( !file ) {
+		throw std::runtime_error( "Couldn't write points to " + path );
+	}
+}
+
+/// Reads a file written by write_points, ids are the points' positions in it. Files without
+/// any points are rejected, as there would be nothing to query.
+inline std::vector<DynamicPoint> read_points( const std::string& path ) {
+	std::ifstream file( path, std::ios::binary | std::ios::ate );
+	if ( !file ) {
+		throw std::runtime_error( "Couldn't open " + path );
+	}
+	const auto size = static_cast<std::uint64_t>( file.tellg() );
+	file.seekg( 0 );
+	std::uint64_t count = 0;
+	std::uint64_t dimensions = 0;
+	file.read( reinterpret_cast<char*>( &count ), sizeof( count ) );
+	file.read( reinterpret_cast<char*>( &dimensions ), sizeof( dimensions ) );
+	count = little_endian( count );
+	dimensions = little_endian( dimensions );
+	// both sizes come from the file, so the bound on dimensions is found by dividing, which a
+	// corrupt header can't overflow into a product that matches the file's size
+	const std::uint64_t payload = size - ( 2 * sizeof( std::uint64_t ) );
+	if ( !file || count == 0 || dimensions == 0 ||
+		 count > std::numeric_limits<std::uint32_t>::max() ||
+		 dimensions > payload / sizeof( double ) / count ||
+		 payload != count * dimensions * sizeof( double ) ) {
+		throw std::runtime_error( path + " isn't a point file" );
+	}
+	std::vector<DynamicPoint> points( count );
+	for ( std::size_t i = 0; i < count; i++ ) {
+		points[i].coordinates.resize( dimensions );
+		file.read(
+			reinterpret_cast<char*>( points[i].coordinates.data() ),
+			static_cast<std::streamsize>( dimensions * sizeof( double ) )
+		);
+		for ( double& coordinate : points[i].coordinates ) {
+			coordinate = little_endian( coordinate );
+		}
+		points[i].id = static_cast<std::uint32_t>( i );
+	}
+	return points;
+}
+
+// NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+
+}  // namespace spatial_lib_benchmark
+
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+#endif
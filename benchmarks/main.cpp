@@ -0,0 +1,381 @@
+// Benchmarks of building and querying KD_Tree, run with --help for the options
+#include "../expirements/kd_tree/kd_tree_layer_optimized.hpp"
+#include "../expirements/kd_tree/kd_tree_recursive.hpp"
+#include "../expirements/kd_tree/kd_tree_recursive_template.hpp"
+#include "../expirements/kd_tree/kd_tree_recursive_virtual.hpp"
+#include "../expirements/kd_tree/kd_tree_stack_optimized.hpp"
+#include "../expirements/kd_tree/kd_tree_stack_template.hpp"
+#include "../kd_tree.hpp"
+#include "./benchmark.hpp"
+#include "./datasets.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+namespace {
+
+using spatial_lib_benchmark::clustered_points;
+using spatial_lib_benchmark::do_not_optimize;
+using spatial_lib_benchmark::duplicate_points;
+using spatial_lib_benchmark::embedded_points;
+using spatial_lib_benchmark::line_points;
+using spatial_lib_benchmark::Options;
+using spatial_lib_benchmark::PerfCounters;
+using spatial_lib_benchmark::Report;
+using spatial_lib_benchmark::road_network_points;
+using spatial_lib_benchmark::Summary;
+using spatial_lib_benchmark::uniform_points;
+
+using Counters = std::vector<std::pair<std::string, double>>;
+
+/// Hardware counts per operation go after the other counters
+Counters with_counts( const PerfCounters& counters, Counters extra, const std::size_t operations ) {
+	for ( auto& count : counters.read( static_cast<double>( operations ) ) ) {
+		extra.push_back( std::move( count ) );
+	}
+	return extra;
+}
+
+/// Queries at points of the data moved by a little noise, so they land where the data is
+template <typename Point>
+std::vector<decltype( Point::coordinates )> queries_near(
+	const std::vector<Point>& points, const std::size_t count, const unsigned int seed
+) {
+	std::mt19937 generator( seed );
+	std::uniform_int_distribution<std::size_t> pick( 0, points.size() - 1 );
+	std::normal_distribution<double> noise( 0.0, 1.0 );
+	std::vector<decltype( Point::coordinates )> queries( count );
+	for ( auto& query : queries ) {
+		query = points[pick( generator )].coordinates;
+		for ( double& coordinate : query ) {
+			coordinate += noise( generator );
+		}
+	}
+	return queries;
+}
+
+template <typename Point>
+void run_dataset(
+	const Options& options,
+	Report& report,
+	PerfCounters& counters,
+	const std::string& dataset,
+	const std::vector<Point>& points
+) {
+	using Coordinates = decltype( Point::coordinates );
+	const std::vector<Coordinates> queries = queries_near( points, options.queries, 2 );
+	auto add = [&]( const std::string& name,
+					const std::string& unit,
+					std::vector<double> data,
+					Counters extra = {} ) {
+		const Summary summary = spatial_lib_benchmark::summarize( std::move( data ) );
+		report.add(
+			{ name, dataset, points.size(), unit, summary, std::move( extra ) }, std::cout
+		);
+	};
+	auto add_queries = [&]( const std::string& name, auto&& query, Counters extra = {} ) {
+		if ( options.selected( name ) ) {
+			std::vector<double> samples =
+				spatial_lib_benchmark::time_each_query( options, queries.size(), query, &counters );
+			add( name,
+				 "ns/query",
+				 std::move( samples ),
+				 with_counts( counters, std::move( extra ), queries.size() ) );
+		}
+	};
+
+	if ( options.selected( "build" ) ) {
+		std::vector<double> samples = spatial_lib_benchmark::repeat(
+			options,
+			[&] {
+				auto data = std::make_shared<std::vector<Point>>( points );
+				return spatial_lib_benchmark::time_ns(
+					[&] {
+						const spatial_lib::KD_Tree tree( data );
+						do_not_optimize( tree.size() );
+					},
+					&counters
+				);
+			},
+			&counters
+		);
+		Counters build = with_counts( counters, {}, options.repetitions );
+
+		// where one more build spends its time and memory, for seeing whether sorting or linking
+		// dominates on this data
+		const spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point>>( points ) );
+		const spatial_lib::kd_tree_types::BuildReport built = tree.build_report();
+		std::chrono::nanoseconds presort{};
+		for ( const std::chrono::nanoseconds dimension : built.phases.presort ) {
+			presort += dimension;
+		}
+		for ( const auto& [name, time] :
+			  { std::pair( "node_creation_ns", built.phases.node_creation ),
+				std::pair( "presort_ns", presort ),
+				std::pair( "link_ns", built.phases.link ),
+				std::pair( "summarize_ns", built.phases.summarize ) } ) {
+			build.emplace_back( name, static_cast<double>( time.count() ) );
+		}
+		build.emplace_back( "memory_bytes", static_cast<double>( built.memory.total() ) );
+		build.emplace_back( "height", static_cast<double>( built.shape.height ) );
+		build.emplace_back( "imbalance", built.shape.imbalance );
+		add( "build", "ns/build", std::move( samples ), std::move( build ) );
+	}
+
+	const spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point>>( points ) );
+
+	// a radius and box holding about 10 points around a typical query
+	std::vector<double> tenth;
+	for ( std::size_t i = 0; i < std::min<std::size_t>( queries.size(), 1000 ); i++ ) {
+		const Point* neighbor = tree.nearest_neighbors( queries[i], 10 ).back();
+		tenth.push_back( spatial_lib::kd_tree_metrics::Euclidean().distance<0, double>(
+			neighbor->coordinates, queries[i], queries[i].size()
+		) );
+	}
+	const double radius = spatial_lib_benchmark::summarize( tenth ).median;
+
+	add_queries( "nearest_neighbor", [&]( const std::size_t i ) {
+		do_not_optimize( tree.nearest_neighbor( queries[i] ) );
+	} );
+	add_queries( "nearest_neighbors_10", [&]( const std::size_t i ) {
+		do_not_optimize( tree.nearest_neighbors( queries[i], 10 ).data() );
+	} );
+	// the same queries interleaved, timed as a whole batch since they finish out of order
+	if ( options.selected( "nearest_neighbors_10_batch" ) ) {
+		constexpr std::size_t group = 8;
+		const spatial_lib::kd_tree_metrics::Euclidean metric;
+		auto batch = [&] {
+			do_not_optimize( tree.nearest_neighbors_batch( queries, 10, metric, group ).data() );
+		};
+		std::vector<double> samples = spatial_lib_benchmark::repeat(
+			options,
+			[&] {
+				return spatial_lib_benchmark::time_ns( batch, &counters ) /
+					static_cast<double>( queries.size() );
+			},
+			&counters
+		);
+		add( "nearest_neighbors_10_batch",
+			 "ns/query",
+			 std::move( samples ),
+			 with_counts(
+				 counters,
+				 { { "group", static_cast<double>( group ) } },
+				 options.repetitions * queries.size()
+			 ) );
+	}
+	add_queries(
+		"within_radius",
+		[&]( const std::size_t i ) {
+			do_not_optimize( tree.within_radius( queries[i], radius ).data() );
+		},
+		{ { "radius", radius } }
+	);
+	add_queries(
+		"in_box",
+		[&]( const std::size_t i ) {
+			Coordinates lower = queries[i];
+			Coordinates upper = queries[i];
+			for ( std::size_t dim = 0; dim < lower.size(); dim++ ) {
+				lower[dim] -= radius;
+				upper[dim] += radius;
+			}
+			do_not_optimize( tree.in_box( lower, upper ).data() );
+		},
+		{ { "half_width", radius } }
+	);
+
+	// how much the subtree boxes prune over the split planes alone on this data
+	if ( options.selected( "visited_nodes" ) ) {
+		std::vector<double> with_boxes;
+		std::vector<double> split_planes;
+		for ( const Coordinates& query : queries ) {
+			with_boxes.push_back( static_cast<double>( tree.count_visited_nodes( query, 10 ) ) );
+			split_planes.push_back(
+				static_cast<double>( tree.count_visited_nodes( query, 10, false ) )
+			);
+		}
+		add( "visited_nodes_10_boxes", "nodes/query", with_boxes );
+		add( "visited_nodes_10_planes", "nodes/query", split_planes );
+	}
+}
+
+/// Walks down an experiment tree towards the point query, one split dimension after another,
+/// to the node holding it. The variants have no searches of their own, and this is the first
+/// phase of any, following their links the same way.
+template <typename Node, typename Point>
+const Node* descend( const Node* node, const Point& query ) {
+	for ( std::size_t depth = 0; node != nullptr && node->data->id != query.id; depth++ ) {
+		const std::size_t dim = depth % std::size( query.coordinates );
+		node = query.coordinates[dim] < node->data->coordinates[dim] ? node->left : node->right;
+	}
+	return node;
+}
+
+/// Builds the experiment tree Tree on points, which its constructor takes by mutable reference,
+/// timing only the construction as the experiments did. Then descends one of them to each of
+/// queries, whose counters show whether the ways of linking differ in memory or branching.
+template <typename Tree, typename Point>
+void run_variant(
+	const Options& options,
+	Report& report,
+	PerfCounters& counters,
+	const std::string& variant,
+	std::vector<Point>& points,
+	const std::vector<Point>& queries
+) {
+	auto add = [&]( const std::string& name,
+					const std::string& unit,
+					std::vector<double> samples,
+					Counters extra ) {
+		report.add(
+			{ name,
+			  "line",
+			  points.size(),
+			  unit,
+			  spatial_lib_benchmark::summarize( std::move( samples ) ),
+			  std::move( extra ) },
+			std::cout
+		);
+	};
+
+	if ( options.selected( "build_" + variant ) ) {
+		std::vector<double> samples = spatial_lib_benchmark::repeat(
+			options,
+			[&] {
+				std::optional<Tree> tree;
+				const double time =
+					spatial_lib_benchmark::time_ns( [&] { tree.emplace( points ); }, &counters );
+				do_not_optimize( tree->nearest_neighbor() );
+				return time;
+			},
+			&counters
+		);
+		add( "build_" + variant,
+			 "ns/build",
+			 std::move( samples ),
+			 with_counts( counters, {}, options.repetitions ) );
+	}
+
+	if ( options.selected( "descend_" + variant ) ) {
+		Tree tree( points );
+		const auto* const root = tree.nearest_neighbor();
+		std::vector<double> samples = spatial_lib_benchmark::time_each_query(
+			options,
+			queries.size(),
+			[&]( const std::size_t i ) { do_not_optimize( descend( root, queries[i] ) ); },
+			&counters
+		);
+		add( "descend_" + variant,
+			 "ns/query",
+			 std::move( samples ),
+			 with_counts( counters, {}, queries.size() ) );
+	}
+}
+
+/// The six ways of linking a tree from presorted dimensions in expirements/kd_tree. They take
+/// each level's median from the whole of a dimension rather than from the subtree's points, so
+/// they only link a consistent tree on points that sort the same way in every dimension.
+void run_variants( const Options& options, Report& report, PerfCounters& counters ) {
+	using VariantPoint = spatial_lib_benchmark::IntegerPoint<4>;
+	std::vector<VariantPoint> points = line_points<4>( options.points, 1 );
+	std::vector<VariantPoint> queries( options.queries );
+	std::mt19937 generator( 2 );
+	std::uniform_int_distribution<std::size_t> pick( 0, points.size() - 1 );
+	for ( VariantPoint& query : queries ) {
+		query = points[pick( generator )];
+	}
+	run_variant<spatial_lib_recursive::KD_Tree<VariantPoint>>(
+		options, report, counters, "recursive", points, queries
+	);
+	run_variant<spatial_lib_stack_optimized::KD_Tree<VariantPoint>>(
+		options, report, counters, "stack_optimized", points, queries
+	);
+	run_variant<spatial_lib_layer_optimized::KD_Tree<VariantPoint>>(
+		options, report, counters, "layer_optimized", points, queries
+	);
+	run_variant<spatial_lib_recursive_virtual::KD_Tree<VariantPoint>>(
+		options, report, counters, "recursive_virtual", points, queries
+	);
+	run_variant<spatial_lib_recursive_template::KD_Tree<std::vector<VariantPoint>>>(
+		options, report, counters, "recursive_template", points, queries
+	);
+	run_variant<spatial_lib_stack_template::KD_Tree<std::vector<VariantPoint>>>(
+		options, report, counters, "stack_template", points, queries
+	);
+}
+
+}  // namespace
+
+int main( const int argc, const char* const* const argv ) {
+	const std::vector<std::string> arguments( argv + 1, argv + argc );
+	if ( !arguments.empty() && ( arguments[0] == "--help" || arguments[0] == "-h" ) ) {
+		std::cout << "Usage: " << argv[0] << " [options]\n" << Options::usage;
+		return 0;
+	}
+	Options options;
+	try {
+		options = Options::parse( arguments );
+	} catch ( const std::exception& error ) {
+		std::cerr << error.what() << '\n' << Options::usage;
+		return 1;
+	}
+	const bool pinned = spatial_lib_benchmark::pin_to_cpu( options.cpu );
+	if ( options.cpu >= 0 && !pinned ) {
+		std::cerr << "Couldn't pin to cpu " << options.cpu << ", timings may be noisier\n";
+	}
+
+	PerfCounters counters( options.counters );
+	if ( options.counters && !counters.available() ) {
+		std::cerr << "Hardware counters are unavailable here, reporting timings only\n";
+	}
+
+	Report report;
+	Report::print_header( std::cout );
+	// datasets are only generated when they're going to run
+	auto run = [&]( const std::string& dataset, auto&& generate ) {
+		if ( options.selected_dataset( dataset ) ) {
+			run_dataset( options, report, counters, dataset, generate() );
+		}
+	};
+	const std::size_t count = options.points;
+	try {
+		run( "uniform", [&] { return uniform_points<3>( count, 1 ); } );
+		run( "clustered", [&] { return clustered_points<3>( count, 50, 5.0, 1 ); } );
+		run( "duplicates", [&] { return duplicate_points<3>( count, ( count / 100 ) + 1, 1 ); } );
+		run( "embedded", [&] { return embedded_points<2, 16>( count, 1 ); } );
+		run( "roads", [&] { return road_network_points( count, 1 ); } );
+		if ( options.selected_dataset( "line" ) ) {
+			run_variants( options, report, counters );
+		}
+		if ( !options.load.empty() ) {
+			run( "file", [&] { return spatial_lib_benchmark::read_points( options.load ); } );
+		}
+	} catch ( const std::exception& error ) {
+		std::cerr << error.what() << '\n';
+		return 1;
+	}
+
+	if ( !options.json.empty() ) {
+		std::ofstream json( options.json );
+		report.write_json( json, options, pinned, counters.available() );
+		if ( !json ) {
+			std::cerr << "Couldn't write " << options.json << '\n';
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
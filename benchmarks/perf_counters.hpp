@@ -0,0 +1,177 @@
+// Hardware performance counters around benchmark phases, through Linux perf_event_open
+#ifndef SPATIAL_LIB_PERF_COUNTERS_HPP_
+#define SPATIAL_LIB_PERF_COUNTERS_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace spatial_lib_benchmark {
+
+#ifdef __linux__
+/// The config of a PERF_TYPE_HW_CACHE event counting read misses in cache
+constexpr std::uint64_t perf_read_misses( const std::uint64_t cache ) {
+	return cache | ( PERF_COUNT_HW_CACHE_OP_READ << 8U ) |
+		( PERF_COUNT_HW_CACHE_RESULT_MISS << 16U );
+}
+#endif
+
+/// Counts cycles, instructions, cache, TLB and branch misses while started, of this thread and
+/// any it starts later on, such as the pool behind the parallel tree builds.
+/// Each event is opened on its own so the kernel can multiplex more of them than the PMU has
+/// counters, and readings are scaled by the share of the time each was actually counting.
+/// Events the kernel or hardware refuses, such as in most VMs or under a strict
+/// perf_event_paranoid, are left out, and with none left available() is false and read() empty.
+class PerfCounters {
+	struct Event {
+		const char* name;
+		std::uint32_t type;
+		std::uint64_t config;
+	};
+
+	struct Reading {
+		std::uint64_t value = 0;
+		std::uint64_t enabled = 0;
+		std::uint64_t running = 0;
+	};
+
+#ifdef __linux__
+	static constexpr std::array<Event, 6> events = { {
+		{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ "l1d_misses", PERF_TYPE_HW_CACHE, perf_read_misses( PERF_COUNT_HW_CACHE_L1D ) },
+		{ "llc_misses", PERF_TYPE_HW_CACHE, perf_read_misses( PERF_COUNT_HW_CACHE_LL ) },
+		{ "dtlb_misses", PERF_TYPE_HW_CACHE, perf_read_misses( PERF_COUNT_HW_CACHE_DTLB ) },
+		{ "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	} };
+#else
+	static constexpr std::array<Event, 0> events = {};
+#endif
+
+	struct Open {
+		const char* name;
+		int descriptor;
+		Reading base;
+	};
+	std::vector<Open> opened;
+
+	static Reading read_event( [[maybe_unused]] const int descriptor ) {
+		Reading reading;
+#ifdef __linux__
+		if ( ::read( descriptor, &reading, sizeof( reading ) ) !=
+			 static_cast<ssize_t>( sizeof( reading ) ) ) {
+			return {};
+		}
+#endif
+		return reading;
+	}
+
+	public:
+	/// With enabled false nothing is opened, for running on timings alone
+	explicit PerfCounters( [[maybe_unused]] const bool enabled = true ) {
+#ifdef __linux__
+		if ( !enabled ) {
+			return;
+		}
+		for ( const Event& event : events ) {
+			perf_event_attr attributes{};
+			attributes.size = sizeof( attributes );
+			attributes.type = event.type;
+			attributes.config = event.config;
+			attributes.disabled = 1;
+			attributes.exclude_kernel = 1;
+			attributes.exclude_hv = 1;
+			attributes.inherit = 1;
+			attributes.read_format =
+				PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			const auto descriptor =
+				static_cast<int>( syscall( SYS_perf_event_open, &attributes, 0, -1, -1, 0 ) );
+			if ( descriptor >= 0 ) {
+				opened.push_back( { event.name, descriptor, {} } );
+			}
+		}
+#endif
+	}
+
+	PerfCounters( const PerfCounters& ) = delete;
+	PerfCounters& operator=( const PerfCounters& ) = delete;
+	PerfCounters( PerfCounters&& ) = delete;
+	PerfCounters& operator=( PerfCounters&& ) = delete;
+
+	~PerfCounters() {
+#ifdef __linux__
+		for ( const Open& event : opened ) {
+			close( event.descriptor );
+		}
+#endif
+	}
+
+	bool available() const {
+		return !opened.empty();
+	}
+
+	/// Counting adds up over every start() to stop() until the next reset()
+	void reset() {
+		for ( Open& event : opened ) {
+			event.base = read_event( event.descriptor );
+		}
+	}
+
+	void start() const {
+#ifdef __linux__
+		for ( const Open& event : opened ) {
+			ioctl( event.descriptor, PERF_EVENT_IOC_ENABLE, 0 );
+		}
+#endif
+	}
+
+	void stop() const {
+#ifdef __linux__
+		for ( const Open& event : opened ) {
+			ioctl( event.descriptor, PERF_EVENT_IOC_DISABLE, 0 );
+		}
+#endif
+	}
+
+	/// The counts since reset() divided by operations, along with instructions per cycle
+	/// when both were counted. An event that never got onto the PMU is left out.
+	std::vector<std::pair<std::string, double>> read( const double operations ) const {
+		std::vector<std::pair<std::string, double>> counts;
+		double cycles = 0;
+		double instructions = 0;
+		for ( const Open& event : opened ) {
+			const Reading now = read_event( event.descriptor );
+			const std::uint64_t running = now.running - event.base.running;
+			if ( running == 0 ) {
+				continue;
+			}
+			const double count = static_cast<double>( now.value - event.base.value ) *
+				static_cast<double>( now.enabled - event.base.enabled ) /
+				static_cast<double>( running );
+			const std::string name = event.name;
+			if ( name == "cycles" ) {
+				cycles = count;
+			} else if ( name == "instructions" ) {
+				instructions = count;
+			}
+			counts.emplace_back( name, count / operations );
+		}
+		if ( cycles > 0 && instructions > 0 ) {
+			counts.emplace_back( "ipc", instructions / cycles );
+		}
+		return counts;
+	}
+};
+
+}  // namespace spatial_lib_benchmark
+
+#endif
\ No newline at end of file
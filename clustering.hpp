@@ -0,0 +1,985 @@
+////////////////////////////////////////////////////////////////////////////////
+/* Copyright (c) <2024> <Aidan Welch>
+
+Permission is hereby granted, free of charge, to any person (except as 
+specified below) obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without restriction, including 
+without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom 
+the Software is furnished to do so, subject to the following conditions:
+
+This permission IS NOT granted for use by or distribution to entities within
+any or all of the following categories:
+	- Annual Revenue in any year since 2020 exceeding $250,000 US Dollars.
+	- Government Entities
+	- Total funding from all government entities exceeding $10,000 US Dollars.
+	- Political Action Committees
+	- Received any funding from a Political Action Committee.
+
+Entities within these categories should contact the copyright holder for
+licensing at: aidan@freedwave.com
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software. The notice should be clearly
+accessible to end users.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+/* Acknowledgements:
+
+DBSCAN:
+	"A Density-Based Algorithm for Discovering Clusters in Large Spatial Databases with Noise"
+	Martin Ester, Hans-Peter Kriegel, Jörg Sander, and Xiaowei Xu
+	Proceedings of the Second International Conference on Knowledge Discovery and Data Mining, 1996
+
+k-means filtering:
+	"An Efficient k-Means Clustering Algorithm: Analysis and Implementation"
+	Tapas Kanungo, David M. Mount, Nathan S. Netanyahu, Christine D. Piatko, Ruth Silverman,
+	and Angela Y. Wu
+	https://doi.org/10.1109/TPAMI.2002.1017616
+
+Dual-tree Borůvka:
+	"Fast Euclidean Minimum Spanning Tree: Algorithm, Analysis, and Applications"
+	William B. March, Parikshit Ram, and Alexander G. Gray
+	https://doi.org/10.1145/1835804.1835882
+
+HDBSCAN:
+	"Density-Based Clustering Based on Hierarchical Density Estimates"
+	Ricardo J. G. B. Campello, Davoud Moulavi, and Jörg Sander
+	https://doi.org/10.1007/978-3-642-37456-2_14
+
+	"Accelerated Hierarchical Density Based Clustering"
+	Leland McInnes and John Healy
+	https://doi.org/10.1109/ICDMW.2017.12
+*/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SPATIAL_LIB_CLUSTERING_HPP_
+#define SPATIAL_LIB_CLUSTERING_HPP_
+
+#include "kd_tree.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <execution>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace spatial_lib {
+
+namespace clustering_detail {
+
+template <typename Input> constexpr std::size_t input_dimensions = [] {
+	if constexpr ( kd_tree_types::InputContainsStaticCoordinates<Input> ) {
+		return kd_tree_types::staticDimensions<Input>;
+	} else {
+		return std::size_t( 0 );
+	}
+}();
+
+template <typename A, typename B>
+double squared_distance( const A& a, const B& b, const std::size_t dimensions ) {
+	double total = 0;
+	for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+		const double difference = static_cast<double>( a[dim] ) - static_cast<double>( b[dim] );
+		total += difference * difference;
+	}
+	return total;
+}
+
+/// One Lloyd step of the filtering algorithm of Kanungo et al. Each subtree is visited with
+/// the centers that could still be closest to some point in its box. A center is dropped when
+/// the box corner furthest towards it from the center closest to the box midpoint is still
+/// closer to that center, and once only one is left the whole subtree's sum and size go to it.
+template <typename Tree, typename Center> struct KMeansFilter {
+	using Subtree = typename Tree::Subtree;
+
+	const std::vector<Center>& centers;
+	std::size_t dimensions;
+
+	/// Per center coordinate sums, flattened, and point counts
+	struct Totals {
+		std::vector<double> sums;
+		std::vector<std::size_t> counts;
+	};
+
+	/// When not null every point's center is written here by its input position
+	std::size_t* labels = nullptr;
+	const void* first = nullptr;
+
+	Totals empty_totals() const {
+		return { std::vector<double>( centers.size() * dimensions, 0.0 ),
+				 std::vector<std::size_t>( centers.size(), 0 ) };
+	}
+
+	template <typename DataType> std::size_t position( const DataType& point ) const {
+		return static_cast<std::size_t>( &point - static_cast<const DataType*>( first ) );
+	}
+
+	void label_subtree( const Subtree subtree, const std::size_t center ) const {
+		if ( subtree ) {
+			labels[position( subtree.point() )] = center;
+			label_subtree( subtree.left(), center );
+			label_subtree( subtree.right(), center );
+		}
+	}
+
+	/// Drops the candidates that can't be closest to anything in subtree's box
+	void prune( const Subtree subtree, std::vector<std::size_t>& candidates ) const {
+		if ( candidates.size() < 2 ) {
+			return;
+		}
+		const auto* lower = subtree.lower();
+		const auto* upper = subtree.upper();
+		std::size_t closest = candidates[0];
+		double closest_distance = std::numeric_limits<double>::max();
+		for ( const std::size_t candidate : candidates ) {
+			double distance = 0;
+			for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+				const double midpoint =
+					( static_cast<double>( lower[dim] ) + static_cast<double>( upper[dim] ) ) / 2;
+				distance += ( centers[candidate][dim] - midpoint ) * ( centers[candidate][dim] - midpoint );
+			}
+			if ( distance < closest_distance ) {
+				closest_distance = distance;
+				closest = candidate;
+			}
+		}
+		std::erase_if( candidates, [&]( const std::size_t candidate ) {
+			if ( candidate == closest ) {
+				return false;
+			}
+			double to_candidate = 0;
+			double to_closest = 0;
+			for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+				const double corner = static_cast<double>(
+					centers[candidate][dim] > centers[closest][dim] ? upper[dim] : lower[dim]
+				);
+				to_candidate += ( centers[candidate][dim] - corner ) * ( centers[candidate][dim] - corner );
+				to_closest += ( centers[closest][dim] - corner ) * ( centers[closest][dim] - corner );
+			}
+			return to_closest <= to_candidate;
+		} );
+	}
+
+	/// Adds subtree to totals, handing the subtrees at split_depth to tasks instead when
+	/// split_depth isn't 0
+	void filter(
+		const Subtree subtree,
+		std::vector<std::size_t> candidates,
+		Totals& totals,
+		const std::size_t depth,
+		const std::size_t split_depth,
+		std::vector<std::pair<Subtree, std::vector<std::size_t>>>* tasks
+	) const {
+		if ( !subtree ) {
+			return;
+		}
+		prune( subtree, candidates );
+		if ( candidates.size() == 1 ) {
+			const std::size_t center = candidates[0];
+			for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+				totals.sums[( center * dimensions ) + dim] += subtree.aggregate()[dim];
+			}
+			totals.counts[center] += subtree.size();
+			if ( labels != nullptr ) {
+				label_subtree( subtree, center );
+			}
+			return;
+		}
+		if ( tasks != nullptr && depth == split_depth ) {
+			tasks->emplace_back( subtree, std::move( candidates ) );
+			return;
+		}
+
+		std::size_t nearest = candidates[0];
+		double nearest_distance = std::numeric_limits<double>::max();
+		for ( const std::size_t candidate : candidates ) {
+			const double distance =
+				squared_distance( centers[candidate], subtree.point().coordinates, dimensions );
+			if ( distance < nearest_distance ) {
+				nearest_distance = distance;
+				nearest = candidate;
+			}
+		}
+		for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+			totals.sums[( nearest * dimensions ) + dim] +=
+				static_cast<double>( subtree.point().coordinates[dim] );
+		}
+		totals.counts[nearest]++;
+		if ( labels != nullptr ) {
+			labels[position( subtree.point() )] = nearest;
+		}
+		filter( subtree.left(), candidates, totals, depth + 1, split_depth, tasks );
+		filter( subtree.right(), std::move( candidates ), totals, depth + 1, split_depth, tasks );
+	}
+
+	/// The totals over the whole tree, the subtrees below the split filtered in parallel
+	Totals run( const Tree& tree ) const {
+		Totals totals = empty_totals();
+		std::vector<std::size_t> all( centers.size() );
+		std::iota( all.begin(), all.end(), std::size_t( 0 ) );
+		std::vector<std::pair<Subtree, std::vector<std::size_t>>> tasks;
+		filter( tree.root_subtree(), std::move( all ), totals, 0, tree.parallel_split_depth(), &tasks );
+
+		std::vector<Totals> task_totals( tasks.size() );
+		std::for_each( std::execution::par, tasks.begin(), tasks.end(), [&]( auto& task ) {
+			Totals& own = task_totals[static_cast<std::size_t>( &task - tasks.data() )];
+			own = empty_totals();
+			filter( task.first, std::move( task.second ), own, 0, 0, nullptr );
+		} );
+		for ( const Totals& own : task_totals ) {
+			for ( std::size_t i = 0; i < own.sums.size(); i++ ) {
+				totals.sums[i] += own.sums[i];
+			}
+			for ( std::size_t i = 0; i < own.counts.size(); i++ ) {
+				totals.counts[i] += own.counts[i];
+			}
+		}
+		return totals;
+	}
+};
+
+}  // namespace clustering_detail
+
+/// Union-find over the indices [0, size) that any number of threads can unite and find in at
+/// once. Roots are only ever linked under a smaller index, so concurrent links can't form a
+/// cycle, and a failed link just retries from the new roots.
+class ConcurrentDisjointSets {
+	std::vector<std::atomic<std::size_t>> parents;
+
+	public:
+	explicit ConcurrentDisjointSets( const std::size_t size ) : parents( size ) {
+		for ( std::size_t i = 0; i < size; i++ ) {
+			parents[i].store( i, std::memory_order_relaxed );
+		}
+	}
+
+	/// The root of element's set, halving the path on the way up
+	std::size_t find( std::size_t element ) {
+		while ( true ) {
+			std::size_t parent = parents[element].load( std::memory_order_acquire );
+			if ( parent == element ) {
+				return element;
+			}
+			const std::size_t grandparent = parents[parent].load( std::memory_order_acquire );
+			if ( grandparent != parent ) {
+				parents[element].compare_exchange_weak( parent, grandparent, std::memory_order_acq_rel );
+			}
+			element = grandparent;
+		}
+	}
+
+	void unite( std::size_t a, std::size_t b ) {
+		while ( true ) {
+			a = find( a );
+			b = find( b );
+			if ( a == b ) {
+				return;
+			}
+			if ( a < b ) {
+				std::swap( a, b );
+			}
+			std::size_t expected = a;
+			if ( parents[a].compare_exchange_strong( expected, b, std::memory_order_acq_rel ) ) {
+				return;
+			}
+		}
+	}
+
+	[[nodiscard]] std::size_t size() const { return parents.size(); }
+};
+
+/// The label dbscan gives points that are in no cluster
+constexpr std::size_t dbscan_noise = std::numeric_limits<std::size_t>::max();
+
+/// DBSCAN over input, returning a cluster label from 0 for each point in input order, or
+/// dbscan_noise. A point is a core point when at least min_points points, itself included, are
+/// within radius of it. Core points are counted in parallel, then one self join of the tree
+/// unites neighbouring core points and gives each border point a neighbouring core point's
+/// cluster.
+template <
+	kd_tree_types::IsValidInput Input,
+	typename Metric = kd_tree_metrics::Euclidean>
+	requires( !kd_tree_metrics::IsPeriodic<Metric> )
+std::vector<std::size_t> dbscan(
+	const std::shared_ptr<Input>& input,
+	const double radius,
+	const std::size_t min_points,
+	const Metric& metric = Metric()
+) {
+	using DataType = std::remove_reference_t<decltype( *std::begin( *input ) )>;
+	const KD_Tree tree( input );
+	const DataType* first = std::data( *input );
+	const std::size_t count = std::size( *input );
+
+	std::vector<std::uint8_t> core( count, 0 );
+	std::for_each( std::execution::par, first, first + count, [&]( const DataType& point ) {
+		core[static_cast<std::size_t>( &point - first )] =
+			tree.count_within_radius( point.coordinates, radius, metric ) >= min_points ? 1 : 0;
+	} );
+
+	ConcurrentDisjointSets clusters( count );
+	std::vector<std::atomic<std::size_t>> border_core( count );
+	for ( std::atomic<std::size_t>& border : border_core ) {
+		border.store( dbscan_noise, std::memory_order_relaxed );
+	}
+	tree.self_join_within_radius(
+		radius,
+		[&]( const DataType* a, const DataType* b ) {
+			const auto a_index = static_cast<std::size_t>( a - first );
+			const auto b_index = static_cast<std::size_t>( b - first );
+			if ( core[a_index] != 0 && core[b_index] != 0 ) {
+				clusters.unite( a_index, b_index );
+			} else if ( core[a_index] != 0 || core[b_index] != 0 ) {
+				const std::size_t core_index = core[a_index] != 0 ? a_index : b_index;
+				const std::size_t border_index = core[a_index] != 0 ? b_index : a_index;
+				std::size_t expected = dbscan_noise;
+				border_core[border_index].compare_exchange_strong( expected, core_index );
+			}
+		},
+		metric
+	);
+
+	// number the clusters in order of their first point
+	std::vector<std::size_t> labels( count, dbscan_noise );
+	std::vector<std::size_t> root_labels( count, dbscan_noise );
+	std::size_t next_label = 0;
+	for ( std::size_t i = 0; i < count; i++ ) {
+		std::size_t member = i;
+		if ( core[i] == 0 ) {
+			member = border_core[i].load( std::memory_order_relaxed );
+			if ( member == dbscan_noise ) {
+				continue;
+			}
+		}
+		const std::size_t root = clusters.find( member );
+		if ( root_labels[root] == dbscan_noise ) {
+			root_labels[root] = next_label++;
+		}
+		labels[i] = root_labels[root];
+	}
+	return labels;
+}
+
+/// Cluster centers as doubles, an array when Input's dimensions are static
+template <kd_tree_types::IsValidInput Input> using KMeansCenter =
+	typename kd_tree_aggregates::CoordinateSum<clustering_detail::input_dimensions<Input>>::value_type;
+
+template <typename Center> struct KMeansResult {
+	std::vector<Center> centers;
+	/// The index of each point's center, in input order
+	std::vector<std::size_t> labels;
+	std::size_t iterations = 0;
+};
+
+/// Lloyd's k-means from initial_centers, over a KD_Tree built once over input whose subtrees
+/// keep their coordinate sums. Each iteration filters the centers down the tree, so subtrees
+/// that are provably nearest to one center are assigned as a whole. Stops after max_iterations
+/// or once no center moves more than tolerance times the diagonal of the data's bounding box.
+/// A center that loses all of its points stays where it is.
+template <kd_tree_types::IsValidInput Input>
+KMeansResult<KMeansCenter<Input>> kmeans(
+	const std::shared_ptr<Input>& input,
+	std::vector<KMeansCenter<Input>> initial_centers,
+	const std::size_t max_iterations = 100,
+	const double tolerance = 1e-9
+) {
+	using Center = KMeansCenter<Input>;
+	using Sum = kd_tree_aggregates::CoordinateSum<clustering_detail::input_dimensions<Input>>;
+	const KD_Tree tree( input, Sum() );
+	using Filter = clustering_detail::KMeansFilter<std::remove_const_t<decltype( tree )>, Center>;
+
+	KMeansResult<Center> result = { std::move( initial_centers ), {}, 0 };
+	const std::size_t dimensions = tree.get_dimensions();
+	if ( tree.size() == 0 || result.centers.empty() ) {
+		result.labels.assign( tree.size(), 0 );
+		return result;
+	}
+	const double extent = clustering_detail::squared_distance(
+		tree.root_subtree().lower(), tree.root_subtree().upper(), dimensions
+	);
+	const double squared_tolerance = tolerance * tolerance * extent;
+
+	Filter filter = { result.centers, dimensions };
+	while ( result.iterations < max_iterations ) {
+		const typename Filter::Totals totals = filter.run( tree );
+		result.iterations++;
+		double largest_move = 0;
+		for ( std::size_t center = 0; center < result.centers.size(); center++ ) {
+			if ( totals.counts[center] == 0 ) {
+				continue;
+			}
+			Center moved = result.centers[center];
+			for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+				moved[dim] = totals.sums[( center * dimensions ) + dim] /
+					static_cast<double>( totals.counts[center] );
+			}
+			largest_move = std::max(
+				largest_move,
+				clustering_detail::squared_distance( moved, result.centers[center], dimensions )
+			);
+			result.centers[center] = std::move( moved );
+		}
+		if ( largest_move <= squared_tolerance ) {
+			break;
+		}
+	}
+
+	result.labels.resize( tree.size() );
+	filter.labels = result.labels.data();
+	filter.first = std::data( *input );
+	filter.run( tree );
+	return result;
+}
+
+/// As above, starting from k distinct points of input picked at random with seed
+template <kd_tree_types::IsValidInput Input>
+KMeansResult<KMeansCenter<Input>> kmeans(
+	const std::shared_ptr<Input>& input,
+	const std::size_t k,
+	const std::size_t max_iterations = 100,
+	const unsigned int seed = 0,
+	const double tolerance = 1e-9
+) {
+	const std::size_t count = std::size( *input );
+	// Floyd's sampling, k distinct picks without touching the other points
+	std::vector<std::size_t> picks;
+	std::unordered_set<std::size_t> picked;
+	std::mt19937 generator( seed );
+	for ( std::size_t last = count - std::min( k, count ); last < count; last++ ) {
+		std::size_t pick = std::uniform_int_distribution<std::size_t>( 0, last )( generator );
+		if ( !picked.insert( pick ).second ) {
+			pick = last;
+			picked.insert( pick );
+		}
+		picks.push_back( pick );
+	}
+
+	std::vector<KMeansCenter<Input>> centers;
+	for ( const std::size_t pick : picks ) {
+		const auto& coordinates = std::data( *input )[pick].coordinates;
+		KMeansCenter<Input> center{};
+		if constexpr ( clustering_detail::input_dimensions<Input> == 0 ) {
+			center.resize( std::size( coordinates ) );
+		}
+		for ( std::size_t dim = 0; dim < center.size(); dim++ ) {
+			center[dim] = static_cast<double>( coordinates[dim] );
+		}
+		centers.push_back( std::move( center ) );
+	}
+	return kmeans( input, std::move( centers ), max_iterations, tolerance );
+}
+
+/// An edge of a spanning tree between the points at input positions a and b
+struct SpanningEdge {
+	std::size_t a;
+	std::size_t b;
+	double distance;
+};
+
+namespace clustering_detail {
+
+/// Dual-tree Borůvka (March et al.) over one tree. Each round finds the shortest edge leaving
+/// every component, traversing the tree against itself. A pair of subtrees is dropped when both
+/// lie in one component, or when their boxes are further apart than the worst current edge of
+/// any component in the query subtree. With core distances the edges are the mutual
+/// reachability distances, max( core a, core b, distance ). Everything is squared.
+template <typename Tree> struct Boruvka {
+	using Subtree = typename Tree::Subtree;
+	using DataType = std::remove_cvref_t<decltype( std::declval<Subtree>().point() )>;
+
+	static constexpr std::size_t mixed = std::numeric_limits<std::size_t>::max();
+	static constexpr double unbounded = std::numeric_limits<double>::max();
+	static constexpr std::size_t lock_count = 256;
+
+	const Tree& tree;
+	const DataType* first;
+	std::size_t dimensions;
+	/// Squared core distances by input position, empty for a plain minimum spanning tree
+	const std::vector<double>& core;
+
+	ConcurrentDisjointSets sets;
+	/// Each point's component root by input position
+	std::vector<std::size_t> component;
+	/// By subtree index, the component every point in the subtree is in or mixed
+	std::vector<std::size_t> subtree_component;
+	std::vector<double> subtree_min_core;
+	std::vector<double> subtree_bound;
+	/// The shortest edge found leaving each component, by component root
+	std::vector<std::atomic<double>> best;
+	std::vector<std::pair<std::size_t, std::size_t>> best_edge;
+	std::vector<std::mutex> locks;
+
+	Boruvka(
+		const Tree& source_tree,
+		const DataType* source_first,
+		const std::vector<double>& core_distances
+	)
+		: tree( source_tree ),
+		  first( source_first ),
+		  dimensions( source_tree.get_dimensions() ),
+		  core( core_distances ),
+		  sets( source_tree.size() ),
+		  component( source_tree.size() ),
+		  subtree_component( source_tree.size() ),
+		  subtree_min_core( source_tree.size(), 0.0 ),
+		  subtree_bound( source_tree.size() ),
+		  best( source_tree.size() ),
+		  best_edge( source_tree.size() ),
+		  locks( lock_count ) {}
+
+	std::size_t position( const Subtree subtree ) const {
+		return static_cast<std::size_t>( &subtree.point() - first );
+	}
+
+	double edge( const std::size_t a, const std::size_t b ) const {
+		const double reduced =
+			squared_distance( first[a].coordinates, first[b].coordinates, dimensions );
+		return core.empty() ? reduced : std::max( { reduced, core[a], core[b] } );
+	}
+
+	double point_gap( const Subtree subtree, const std::size_t point ) const {
+		double reduced = 0;
+		for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+			const auto coordinate = static_cast<double>( first[point].coordinates[dim] );
+			const double gap = std::max(
+				{ static_cast<double>( subtree.lower()[dim] ) - coordinate,
+				  coordinate - static_cast<double>( subtree.upper()[dim] ),
+				  0.0 }
+			);
+			reduced += gap * gap;
+		}
+		if ( !core.empty() ) {
+			reduced = std::max( { reduced, core[point], subtree_min_core[subtree.index()] } );
+		}
+		return reduced;
+	}
+
+	double box_gap( const Subtree a, const Subtree b ) const {
+		double reduced = 0;
+		for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+			const double gap = std::max(
+				{ static_cast<double>( b.lower()[dim] ) - static_cast<double>( a.upper()[dim] ),
+				  static_cast<double>( a.lower()[dim] ) - static_cast<double>( b.upper()[dim] ),
+				  0.0 }
+			);
+			reduced += gap * gap;
+		}
+		if ( !core.empty() ) {
+			reduced = std::max(
+				{ reduced, subtree_min_core[a.index()], subtree_min_core[b.index()] }
+			);
+		}
+		return reduced;
+	}
+
+	/// Fills in subtree_component and subtree_min_core bottom up
+	void summarize( const Subtree subtree ) {
+		const std::size_t index = subtree.index();
+		const std::size_t point = position( subtree );
+		subtree_component[index] = component[point];
+		subtree_min_core[index] = core.empty() ? 0.0 : core[point];
+		for ( const Subtree child : { subtree.left(), subtree.right() } ) {
+			if ( child ) {
+				summarize( child );
+				if ( subtree_component[child.index()] != subtree_component[index] ) {
+					subtree_component[index] = mixed;
+				}
+				subtree_min_core[index] =
+					std::min( subtree_min_core[index], subtree_min_core[child.index()] );
+			}
+		}
+	}
+
+	/// Offers the edge to the components at both of its ends
+	void offer( const std::size_t a, const std::size_t b, const double reduced ) {
+		for ( const std::size_t root : { component[a], component[b] } ) {
+			if ( reduced < best[root].load( std::memory_order_relaxed ) ) {
+				const std::lock_guard<std::mutex> lock( locks[root % lock_count] );
+				if ( reduced < best[root].load( std::memory_order_relaxed ) ) {
+					best[root].store( reduced, std::memory_order_relaxed );
+					best_edge[root] = { a, b };
+				}
+			}
+		}
+	}
+
+	void update_bound( const Subtree query ) {
+		double bound = best[component[position( query )]].load( std::memory_order_relaxed );
+		for ( const Subtree child : { query.left(), query.right() } ) {
+			if ( child ) {
+				bound = std::max( bound, subtree_bound[child.index()] );
+			}
+		}
+		subtree_bound[query.index()] = bound;
+	}
+
+	/// Shortest edges from the point at query to anywhere in reference
+	void point_to_reference( const std::size_t query, const Subtree reference ) {
+		const std::size_t root = component[query];
+		if ( subtree_component[reference.index()] == root ||
+			 point_gap( reference, query ) >= best[root].load( std::memory_order_relaxed ) ) {
+			return;
+		}
+		const std::size_t point = position( reference );
+		if ( component[point] != root ) {
+			offer( query, point, edge( query, point ) );
+		}
+		Subtree near = reference.left();
+		Subtree far = reference.right();
+		if ( !near || ( far && point_gap( far, query ) < point_gap( near, query ) ) ) {
+			std::swap( near, far );
+		}
+		for ( const Subtree child : { near, far } ) {
+			if ( child ) {
+				point_to_reference( query, child );
+			}
+		}
+	}
+
+	/// One reference point against every point in query's subtree
+	void point_to_query( const Subtree query, const std::size_t reference ) {
+		if ( subtree_component[query.index()] == component[reference] ||
+			 point_gap( query, reference ) > subtree_bound[query.index()] ) {
+			return;
+		}
+		const std::size_t point = position( query );
+		if ( component[point] != component[reference] ) {
+			offer( point, reference, edge( point, reference ) );
+		}
+		for ( const Subtree child : { query.left(), query.right() } ) {
+			if ( child ) {
+				point_to_query( child, reference );
+			}
+		}
+		update_bound( query );
+	}
+
+	void dual( const Subtree query, const Subtree reference ) {
+		if ( ( subtree_component[query.index()] != mixed &&
+			   subtree_component[query.index()] == subtree_component[reference.index()] ) ||
+			 box_gap( query, reference ) > subtree_bound[query.index()] ) {
+			return;
+		}
+		point_to_reference( position( query ), reference );
+		for ( const Subtree query_child : { query.left(), query.right() } ) {
+			if ( !query_child ) {
+				continue;
+			}
+			point_to_query( query_child, position( reference ) );
+			Subtree near = reference.left();
+			Subtree far = reference.right();
+			if ( !near || ( far && box_gap( query_child, far ) < box_gap( query_child, near ) ) ) {
+				std::swap( near, far );
+			}
+			for ( const Subtree reference_child : { near, far } ) {
+				if ( reference_child ) {
+					dual( query_child, reference_child );
+				}
+			}
+		}
+		update_bound( query );
+	}
+
+	void collect_tasks(
+		const Subtree subtree,
+		const std::size_t depth,
+		const std::size_t split_depth,
+		std::vector<Subtree>& tasks,
+		std::vector<std::size_t>& above
+	) const {
+		if ( !subtree ) {
+			return;
+		}
+		if ( depth == split_depth ) {
+			tasks.push_back( subtree );
+			return;
+		}
+		above.push_back( position( subtree ) );
+		collect_tasks( subtree.left(), depth + 1, split_depth, tasks, above );
+		collect_tasks( subtree.right(), depth + 1, split_depth, tasks, above );
+	}
+
+	/// The n - 1 edges sorted by distance, each distance still squared
+	std::vector<SpanningEdge> run() {
+		const std::size_t count = tree.size();
+		std::vector<SpanningEdge> edges;
+		if ( count < 2 ) {
+			return edges;
+		}
+		edges.reserve( count - 1 );
+		std::vector<Subtree> tasks;
+		std::vector<std::size_t> above;
+		collect_tasks( tree.root_subtree(), 0, tree.parallel_split_depth(), tasks, above );
+
+		while ( edges.size() < count - 1 ) {
+			for ( std::size_t point = 0; point < count; point++ ) {
+				component[point] = sets.find( point );
+				best[point].store( unbounded, std::memory_order_relaxed );
+			}
+			std::fill( subtree_bound.begin(), subtree_bound.end(), unbounded );
+			summarize( tree.root_subtree() );
+
+			std::for_each( std::execution::par, above.begin(), above.end(), [&]( const std::size_t point ) {
+				point_to_reference( point, tree.root_subtree() );
+			} );
+			std::for_each( std::execution::par, tasks.begin(), tasks.end(), [&]( const Subtree task ) {
+				dual( task, tree.root_subtree() );
+			} );
+
+			// shortest first so ties between components can't close a cycle
+			std::vector<SpanningEdge> round;
+			for ( std::size_t root = 0; root < count; root++ ) {
+				if ( component[root] == root && best[root].load( std::memory_order_relaxed ) < unbounded ) {
+					round.push_back(
+						{ best_edge[root].first, best_edge[root].second, best[root].load( std::memory_order_relaxed ) }
+					);
+				}
+			}
+			std::sort( round.begin(), round.end(), []( const SpanningEdge& a, const SpanningEdge& b ) {
+				return a.distance < b.distance;
+			} );
+			const std::size_t before = edges.size();
+			for ( const SpanningEdge& candidate : round ) {
+				if ( sets.find( candidate.a ) != sets.find( candidate.b ) ) {
+					sets.unite( candidate.a, candidate.b );
+					edges.push_back( candidate );
+				}
+			}
+			if ( edges.size() == before ) {
+				break;
+			}
+		}
+		std::sort( edges.begin(), edges.end(), []( const SpanningEdge& a, const SpanningEdge& b ) {
+			return a.distance < b.distance;
+		} );
+		return edges;
+	}
+};
+
+/// The minimum spanning tree of the points of tree, which start at first in their input, under
+/// mutual reachability when core is not empty
+template <typename Tree, typename DataType>
+std::vector<SpanningEdge> spanning_tree(
+	const Tree& tree, const DataType* first, const std::vector<double>& core
+) {
+	Boruvka<Tree> boruvka( tree, first, core );
+	std::vector<SpanningEdge> edges = boruvka.run();
+	for ( SpanningEdge& edge : edges ) {
+		edge.distance = std::sqrt( edge.distance );
+	}
+	return edges;
+}
+
+}  // namespace clustering_detail
+
+/// The Euclidean minimum spanning tree of input by dual-tree Borůvka, n - 1 edges between input
+/// positions sorted by length.
+template <kd_tree_types::IsValidInput Input>
+std::vector<SpanningEdge> euclidean_mst( const std::shared_ptr<Input>& input ) {
+	const KD_Tree tree( input );
+	return clustering_detail::spanning_tree( tree, std::data( *input ), {} );
+}
+
+/// A cluster's child in the condensed tree. Children below the point count are points falling
+/// out of parent, the rest are clusters splitting off it. lambda is 1 / distance at the split.
+struct CondensedEdge {
+	std::size_t parent;
+	std::size_t child;
+	double lambda;
+	std::size_t size;
+};
+
+struct HDBSCANResult {
+	/// The selected cluster of each point from 0 in input order, or hdbscan_noise
+	std::vector<std::size_t> labels;
+	/// The root cluster is numbered the point count, later clusters count up from it
+	std::vector<CondensedEdge> condensed_tree;
+	/// Under mutual reachability distance
+	std::vector<SpanningEdge> spanning_tree;
+};
+
+constexpr std::size_t hdbscan_noise = dbscan_noise;
+
+/// HDBSCAN* (Campello et al.) over input. Core distances are to each point's min_samples-th
+/// nearest neighbour, itself included, and default to min_cluster_size. The minimum spanning
+/// tree under mutual reachability comes from dual-tree Borůvka, its single linkage hierarchy is
+/// condensed to clusters of at least min_cluster_size points, and the clusters with the most
+/// excess of mass are selected, never the root. A min_cluster_size of 0 is taken as 1.
+template <kd_tree_types::IsValidInput Input>
+HDBSCANResult hdbscan(
+	const std::shared_ptr<Input>& input,
+	std::size_t min_cluster_size,
+	std::size_t min_samples = 0
+) {
+	using DataType = std::remove_reference_t<decltype( *std::begin( *input ) )>;
+	min_cluster_size = std::max<std::size_t>( min_cluster_size, 1 );
+	if ( min_samples == 0 ) {
+		min_samples = min_cluster_size;
+	}
+	const DataType* first = std::data( *input );
+	const std::size_t count = std::size( *input );
+	HDBSCANResult result;
+	result.labels.assign( count, hdbscan_noise );
+	if ( count < 2 ) {
+		return result;
+	}
+
+	const KD_Tree tree( input );
+	std::vector<double> core( count, 0.0 );
+	std::for_each( std::execution::par, first, first + count, [&]( const DataType& point ) {
+		const auto neighbors = tree.nearest_neighbors( point.coordinates, min_samples );
+		core[static_cast<std::size_t>( &point - first )] = clustering_detail::squared_distance(
+			neighbors.back()->coordinates, point.coordinates, tree.get_dimensions()
+		);
+	} );
+	result.spanning_tree = clustering_detail::spanning_tree( tree, first, core );
+
+	// single linkage, merge i makes node count + i out of two earlier nodes
+	const std::size_t merges = result.spanning_tree.size();
+	std::vector<std::array<std::size_t, 2>> children( merges );
+	std::vector<std::size_t> sizes( count + merges, 1 );
+	{
+		std::vector<std::size_t> parent( count + merges );
+		std::iota( parent.begin(), parent.end(), std::size_t( 0 ) );
+		auto find = [&]( std::size_t node ) {
+			while ( parent[node] != node ) {
+				parent[node] = parent[parent[node]];
+				node = parent[node];
+			}
+			return node;
+		};
+		for ( std::size_t i = 0; i < merges; i++ ) {
+			const std::size_t a = find( result.spanning_tree[i].a );
+			const std::size_t b = find( result.spanning_tree[i].b );
+			children[i] = { a, b };
+			sizes[count + i] = sizes[a] + sizes[b];
+			parent[a] = count + i;
+			parent[b] = count + i;
+		}
+	}
+	// duplicate points merge at the closest non-zero distance rather than an infinite lambda
+	double closest = 1.0;
+	for ( const SpanningEdge& edge : result.spanning_tree ) {
+		if ( edge.distance > 0.0 ) {
+			closest = edge.distance;
+			break;
+		}
+	}
+	auto lambda_of = [&]( const std::size_t merge ) {
+		return 1.0 / std::max( result.spanning_tree[merge].distance, closest );
+	};
+
+	// condense from the top, a split only makes new clusters when both sides are big enough
+	std::vector<double> birth = { 0.0 };
+	std::vector<std::size_t> cluster_parent = { hdbscan_noise };
+	std::vector<std::pair<std::size_t, std::size_t>> pending = { { count + merges - 1, count } };
+	auto fall_out = [&]( const std::size_t node, const std::size_t cluster, const double lambda ) {
+		std::vector<std::size_t> stack = { node };
+		while ( !stack.empty() ) {
+			const std::size_t current = stack.back();
+			stack.pop_back();
+			if ( current < count ) {
+				result.condensed_tree.push_back( { cluster, current, lambda, 1 } );
+			} else {
+				stack.push_back( children[current - count][0] );
+				stack.push_back( children[current - count][1] );
+			}
+		}
+	};
+	while ( !pending.empty() ) {
+		const auto [node, cluster] = pending.back();
+		pending.pop_back();
+		if ( node < count ) {
+			result.condensed_tree.push_back( { cluster, node, birth[cluster - count], 1 } );
+			continue;
+		}
+		const double lambda = lambda_of( node - count );
+		const auto [left, right] = children[node - count];
+		const bool left_big = sizes[left] >= min_cluster_size;
+		const bool right_big = sizes[right] >= min_cluster_size;
+		if ( left_big && right_big ) {
+			for ( const std::size_t side : { left, right } ) {
+				const std::size_t split = count + birth.size();
+				birth.push_back( lambda );
+				cluster_parent.push_back( cluster );
+				result.condensed_tree.push_back( { cluster, split, lambda, sizes[side] } );
+				pending.emplace_back( side, split );
+			}
+		} else {
+			for ( const std::size_t side : { left, right } ) {
+				if ( sizes[side] >= min_cluster_size ) {
+					pending.emplace_back( side, cluster );
+				} else {
+					fall_out( side, cluster, lambda );
+				}
+			}
+		}
+	}
+
+	// excess of mass, children always have higher numbers than their parents
+	const std::size_t clusters = birth.size();
+	std::vector<double> stability( clusters, 0.0 );
+	for ( const CondensedEdge& edge : result.condensed_tree ) {
+		stability[edge.parent - count] +=
+			( edge.lambda - birth[edge.parent - count] ) * static_cast<double>( edge.size );
+	}
+	std::vector<std::uint8_t> selected( clusters, 1 );
+	selected[0] = 0;
+	std::vector<double> subtree_stability( clusters, 0.0 );
+	for ( std::size_t cluster = clusters; cluster-- > 1; ) {
+		if ( subtree_stability[cluster] > stability[cluster] ) {
+			selected[cluster] = 0;
+		} else {
+			subtree_stability[cluster] = stability[cluster];
+		}
+		subtree_stability[cluster_parent[cluster] - count] += subtree_stability[cluster];
+	}
+	// a selected cluster takes everything below it
+	std::vector<std::uint8_t> covered( clusters, 0 );
+	for ( std::size_t cluster = 1; cluster < clusters; cluster++ ) {
+		const std::size_t parent = cluster_parent[cluster] - count;
+		covered[cluster] = ( covered[parent] != 0 || selected[parent] != 0 ) ? 1 : 0;
+		if ( covered[cluster] != 0 ) {
+			selected[cluster] = 0;
+		}
+	}
+
+	std::vector<std::size_t> owner( clusters, hdbscan_noise );
+	std::size_t next_label = 0;
+	for ( std::size_t cluster = 1; cluster < clusters; cluster++ ) {
+		if ( selected[cluster] != 0 ) {
+			owner[cluster] = next_label++;
+		} else if ( cluster_parent[cluster] != count ) {
+			owner[cluster] = owner[cluster_parent[cluster] - count];
+		}
+	}
+	for ( const CondensedEdge& edge : result.condensed_tree ) {
+		if ( edge.child < count ) {
+			result.labels[edge.child] = owner[edge.parent - count];
+		}
+	}
+	return result;
+}
+
+}  //  namespace spatial_lib
+
+#endif
\ No newline at end of file
@@ -0,0 +1,586 @@
+////////////////////////////////////////////////////////////////////////////////
+/* Copyright (c) <2024> <Aidan Welch>
+
+Permission is hereby granted, free of charge, to any person (except as 
+specified below) obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without restriction, including 
+without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom 
+the Software is furnished to do so, subject to the following conditions:
+
+This permission IS NOT granted for use by or distribution to entities within
+any or all of the following categories:
+	- Annual Revenue in any year since 2020 exceeding $250,000 US Dollars.
+	- Government Entities
+	- Total funding from all government entities exceeding $10,000 US Dollars.
+	- Political Action Committees
+	- Received any funding from a Political Action Committee.
+
+Entities within these categories should contact the copyright holder for
+licensing at: aidan@freedwave.com
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software. The notice should be clearly
+accessible to end users.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+/* Acknowledgements:
+
+Read-copy update:
+	"Read-Copy Update: Using Execution History to Solve Concurrency Problems"
+	Paul E. McKenney and John D. Slingwine
+	Parallel and Distributed Computing and Systems, 1998
+
+Epoch based reclamation:
+	"Practical Lock-Freedom"
+	Keir Fraser
+	University of Cambridge Computer Laboratory Technical Report UCAM-CL-TR-579, 2004
+*/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SPATIAL_LIB_CONCURRENT_KD_TREE_HPP_
+#define SPATIAL_LIB_CONCURRENT_KD_TREE_HPP_
+
+#include "kd_tree.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace spatial_lib {
+
+namespace concurrent_detail {
+
+/// Spreads threads over stripes of per thread state so they don't all contend on one cache line
+template <std::size_t Stripes> std::size_t thread_stripe() {
+	static thread_local const std::size_t index =
+		std::hash<std::thread::id>()( std::this_thread::get_id() ) % Stripes;
+	return index;
+}
+
+/// Epoch based reclamation for one writer at a time. Readers register in the parity of the
+/// current epoch, and the writer flips the epoch twice, waiting for each old parity to empty,
+/// before it frees anything a reader might have seen. Readers never wait on the writer.
+class Epochs {
+	static constexpr std::size_t stripes = 64;
+
+	struct alignas( 64 ) Stripe {
+		std::atomic<std::ptrdiff_t> readers = 0;
+	};
+
+	std::atomic<std::size_t> epoch = 0;
+	std::array<Stripe, 2 * stripes> counts;
+
+	bool parity_empty( const std::size_t parity ) const {
+		for ( std::size_t i = parity * stripes; i < ( parity + 1 ) * stripes; i++ ) {
+			if ( counts[i].readers.load() != 0 ) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	public:
+	/// Registers a reader, returning the slot to pass to leave
+	std::size_t enter() {
+		const std::size_t offset = thread_stripe<stripes>();
+		while ( true ) {
+			const std::size_t current = epoch.load();
+			const std::size_t slot = ( ( current & 1 ) * stripes ) + offset;
+			counts[slot].readers.fetch_add( 1 );
+			// a reader that registered in a parity the writer already moved past retries
+			if ( epoch.load() == current ) {
+				return slot;
+			}
+			counts[slot].readers.fetch_sub( 1 );
+		}
+	}
+
+	void leave( const std::size_t slot ) { counts[slot].readers.fetch_sub( 1 ); }
+
+	/// Returns once every reader that entered before the call has left
+	void synchronize() {
+		for ( int flip = 0; flip < 2; flip++ ) {
+			const std::size_t previous = epoch.fetch_add( 1 );
+			while ( !parity_empty( previous & 1 ) ) {
+				std::this_thread::yield();
+			}
+		}
+	}
+};
+
+/// Append only storage for points inserted since the last merge. Each thread that inserts gets
+/// a segment of its own, with room for capacity points, the first time it inserts into this
+/// buffer, and another whenever its last one fills. Only that thread writes to the segment,
+/// publishing each point by bumping the segment's count, so inserters never share the cache
+/// lines they write points to. Segments start out uninitialized, and only the points actually
+/// inserted are ever constructed. One shared counter totals the points of every segment.
+template <typename DataType> class InsertBuffer {
+	struct alignas( 64 ) Segment {
+		std::thread::id owner;
+		Segment* next;
+		std::atomic<std::size_t> published = 0;
+		[[no_unique_address]] std::allocator<DataType> allocator;
+		DataType* points;
+		std::size_t capacity;
+
+		Segment( const std::thread::id thread, Segment* const following, const std::size_t size )
+			: owner( thread ), next( following ), points( allocator.allocate( size ) ), capacity( size ) {}
+
+		Segment( const Segment& ) = delete;
+		Segment& operator=( const Segment& ) = delete;
+		Segment( Segment&& ) = delete;
+		Segment& operator=( Segment&& ) = delete;
+
+		~Segment() {
+			std::destroy_n( points, published.load( std::memory_order_relaxed ) );
+			allocator.deallocate( points, capacity );
+		}
+	};
+
+	/// Which segment the calling thread last inserted into, and of which buffer. Buffers are
+	/// told apart by id rather than address, as a new one can be allocated where an old one was.
+	struct Cached {
+		std::size_t buffer = 0;
+		Segment* segment = nullptr;
+	};
+
+	static std::size_t next_id() {
+		static std::atomic<std::size_t> ids = 0;
+		return ++ids;
+	}
+
+	std::size_t id = next_id();
+	std::size_t capacity;
+	std::atomic<Segment*> segments = nullptr;
+	alignas( 64 ) std::atomic<std::size_t> total = 0;
+
+	/// Puts a new segment for the calling thread in front of the others, so it's the first of
+	/// the thread's segments found from the head of the list
+	Segment* add_segment( const std::thread::id thread ) {
+		auto* segment = new Segment( thread, segments.load( std::memory_order_relaxed ), capacity );
+		while ( !segments.compare_exchange_weak(
+			segment->next, segment, std::memory_order_release, std::memory_order_relaxed
+		) ) {
+		}
+		return segment;
+	}
+
+	/// The segment the calling thread is filling, adding one when it has none or its last is full
+	Segment& own_segment() {
+		static thread_local Cached cached;
+		if ( cached.buffer != id ) {
+			const std::thread::id thread = std::this_thread::get_id();
+			Segment* segment = segments.load( std::memory_order_acquire );
+			while ( segment != nullptr && segment->owner != thread ) {
+				segment = segment->next;
+			}
+			cached = { id, segment != nullptr ? segment : add_segment( thread ) };
+		}
+		if ( cached.segment->published.load( std::memory_order_relaxed ) == capacity ) {
+			cached.segment = add_segment( cached.segment->owner );
+		}
+		return *cached.segment;
+	}
+
+	public:
+	/// capacity is the size of each segment, the points a thread inserts between allocations
+	explicit InsertBuffer( const std::size_t segment_capacity )
+		: capacity( std::max<std::size_t>( segment_capacity, 1 ) ) {}
+
+	InsertBuffer( const InsertBuffer& ) = delete;
+	InsertBuffer& operator=( const InsertBuffer& ) = delete;
+	InsertBuffer( InsertBuffer&& ) = delete;
+	InsertBuffer& operator=( InsertBuffer&& ) = delete;
+
+	~InsertBuffer() {
+		Segment* segment = segments.load();
+		while ( segment != nullptr ) {
+			delete std::exchange( segment, segment->next );
+		}
+	}
+
+	/// Moves point in and returns how many points the whole buffer holds with it
+	std::size_t push( DataType&& point ) {
+		Segment& segment = own_segment();
+		const std::size_t index = segment.published.load( std::memory_order_relaxed );
+		std::construct_at( segment.points + index, std::move( point ) );
+		segment.published.store( index + 1, std::memory_order_release );
+		return total.fetch_add( 1, std::memory_order_relaxed ) + 1;
+	}
+
+	/// Points published so far, though concurrent pushes may not be counted yet
+	std::size_t size() const { return total.load( std::memory_order_relaxed ); }
+
+	/// Calls function( point ) for every point published so far
+	template <typename Function> void for_each( Function&& function ) {
+		for ( Segment* segment = segments.load( std::memory_order_acquire ); segment != nullptr;
+			  segment = segment->next ) {
+			const std::size_t count = segment->published.load( std::memory_order_acquire );
+			for ( std::size_t i = 0; i < count; i++ ) {
+				function( segment->points[i] );
+			}
+		}
+	}
+};
+
+template <typename Input> concept IsGrowableInput =
+	requires( Input input, typename Input::value_type point, std::size_t size ) {
+		input.push_back( std::move( point ) );
+		input.reserve( size );
+	};
+
+}  // namespace concurrent_detail
+
+/// A KD_Tree that can be rebuilt and inserted into while other threads query it. Queries go
+/// through a Snapshot, which pins the current version without taking a lock. Rebuilds and
+/// merges of inserted points build the next version on a background thread and swap it in
+/// atomically, and a replaced version is freed once every Snapshot taken before the swap has
+/// been destroyed.
+template <
+	kd_tree_types::IsOwnableInput Input,
+	typename Aggregate = kd_tree_aggregates::None,
+	kd_tree_splits::IsSplitRule SplitRule = kd_tree_splits::CyclicMedian>
+class ConcurrentKD_Tree {
+	public:
+	using Tree = KD_Tree<Input, Input, Aggregate, SplitRule>;
+	using DataType = typename Tree::DataType;
+	using CoordinatesType = typename Tree::CoordinatesType;
+	using DistanceType = typename Tree::DistanceType;
+
+	private:
+	using Buffer = concurrent_detail::InsertBuffer<DataType>;
+
+	/// Inserted points live in active until a merge seals it, the sealed buffer is still
+	/// searched while the merged tree is built
+	struct Version {
+		std::shared_ptr<const Tree> tree;
+		std::shared_ptr<Buffer> sealed;
+		std::shared_ptr<Buffer> active;
+
+		template <typename Function> void for_each_buffered( Function&& function ) const {
+			if ( sealed != nullptr ) {
+				sealed->for_each( function );
+			}
+			active->for_each( function );
+		}
+	};
+
+	public:
+	/// Read access to one version of the tree. Points returned by its queries stay valid until
+	/// the Snapshot is destroyed, so keep it short lived, rebuilds can't free memory meanwhile.
+	/// The Snapshot's own queries also scan the points inserted but not yet merged, while
+	/// operator-> reaches every query of the tree on its own.
+	class Snapshot {
+		friend class ConcurrentKD_Tree;
+
+		concurrent_detail::Epochs* epochs;
+		std::size_t slot;
+		const Version* version;
+
+		explicit Snapshot( concurrent_detail::Epochs& reader_epochs, const std::atomic<Version*>& current )
+			: epochs( &reader_epochs ), slot( reader_epochs.enter() ), version( current.load() ) {}
+
+		template <typename Metric>
+		static DistanceType reduced( const DataType& data, const CoordinatesType& point, const Metric& metric ) {
+			return metric.template reduced_distance<0, DistanceType>(
+				data.coordinates, point, std::size( point )
+			);
+		}
+
+		public:
+		Snapshot( const Snapshot& ) = delete;
+		Snapshot& operator=( const Snapshot& ) = delete;
+
+		Snapshot( Snapshot&& other ) noexcept
+			: epochs( std::exchange( other.epochs, nullptr ) ), slot( other.slot ), version( other.version ) {}
+
+		Snapshot& operator=( Snapshot&& other ) noexcept {
+			if ( this != &other ) {
+				release();
+				epochs = std::exchange( other.epochs, nullptr );
+				slot = other.slot;
+				version = other.version;
+			}
+			return *this;
+		}
+
+		~Snapshot() { release(); }
+
+		const Tree& operator*() const { return *version->tree; }
+
+		const Tree* operator->() const { return version->tree.get(); }
+
+		/// Points in the tree plus points inserted into this version
+		std::size_t size() const {
+			std::size_t buffered = 0;
+			version->for_each_buffered( [&]( const DataType& /* data */ ) { buffered++; } );
+			return version->tree->size() + buffered;
+		}
+
+		template <typename Function> void for_each_buffered( Function&& function ) const {
+			version->for_each_buffered( function );
+		}
+
+		template <typename Metric = kd_tree_metrics::Euclidean>
+			requires kd_tree_metrics::IsMetric<Metric, DistanceType>
+		DataType* nearest_neighbor( const CoordinatesType& point, const Metric& metric = Metric() ) const {
+			DataType* nearest = version->tree->nearest_neighbor( point, metric );
+			DistanceType best = std::numeric_limits<DistanceType>::max();
+			if ( nearest != nullptr ) {
+				best = reduced( *nearest, point, metric );
+			}
+			version->for_each_buffered( [&]( DataType& data ) {
+				const DistanceType distance = reduced( data, point, metric );
+				if ( distance < best ) {
+					best = distance;
+					nearest = &data;
+				}
+			} );
+			return nearest;
+		}
+
+		template <typename Metric = kd_tree_metrics::Euclidean>
+			requires kd_tree_metrics::IsMetric<Metric, DistanceType>
+		std::vector<DataType*> nearest_neighbors(
+			const CoordinatesType& point, const std::size_t k, const Metric& metric = Metric()
+		) const {
+			std::vector<std::pair<DistanceType, DataType*>> candidates;
+			for ( DataType* data : version->tree->nearest_neighbors( point, k, metric ) ) {
+				candidates.emplace_back( reduced( *data, point, metric ), data );
+			}
+			version->for_each_buffered( [&]( DataType& data ) {
+				candidates.emplace_back( reduced( data, point, metric ), &data );
+			} );
+			const std::size_t count = std::min( k, candidates.size() );
+			std::partial_sort(
+				candidates.begin(),
+				candidates.begin() + static_cast<std::ptrdiff_t>( count ),
+				candidates.end(),
+				[]( const auto& a, const auto& b ) { return a.first < b.first; }
+			);
+			std::vector<DataType*> neighbors;
+			neighbors.reserve( count );
+			for ( std::size_t i = 0; i < count; i++ ) {
+				neighbors.push_back( candidates[i].second );
+			}
+			return neighbors;
+		}
+
+		template <typename Metric = kd_tree_metrics::Euclidean>
+			requires kd_tree_metrics::IsMetric<Metric, DistanceType>
+		std::vector<DataType*> within_radius(
+			const CoordinatesType& point, const DistanceType radius, const Metric& metric = Metric()
+		) const {
+			std::vector<DataType*> found = version->tree->within_radius( point, radius, metric );
+			const DistanceType reduced_radius = metric.to_reduced( radius );
+			version->for_each_buffered( [&]( DataType& data ) {
+				if ( reduced( data, point, metric ) <= reduced_radius ) {
+					found.push_back( &data );
+				}
+			} );
+			return found;
+		}
+
+		std::vector<DataType*> in_box( const CoordinatesType& lower, const CoordinatesType& upper ) const {
+			std::vector<DataType*> found = version->tree->in_box( lower, upper );
+			version->for_each_buffered( [&]( DataType& data ) {
+				for ( std::size_t dim = 0; dim < std::size( lower ); dim++ ) {
+					if ( data.coordinates[dim] < lower[dim] || upper[dim] < data.coordinates[dim] ) {
+						return;
+					}
+				}
+				found.push_back( &data );
+			} );
+			return found;
+		}
+
+		private:
+		void release() {
+			if ( epochs != nullptr ) {
+				epochs->leave( slot );
+				epochs = nullptr;
+			}
+		}
+	};
+
+	/// Inserted points are merged into the tree on the background thread once about
+	/// merge_threshold of them are buffered.
+	explicit ConcurrentKD_Tree(
+		Input&& input_data,
+		Aggregate tree_aggregate = Aggregate(),
+		SplitRule tree_split_rule = SplitRule(),
+		const std::size_t merge_threshold = 4096
+	)
+		: aggregate( std::move( tree_aggregate ) ),
+		  split_rule( std::move( tree_split_rule ) ),
+		  threshold( std::max<std::size_t>( merge_threshold, 1 ) ),
+		  current( new Version{
+			  std::make_shared<const Tree>( std::move( input_data ), aggregate, split_rule ),
+			  nullptr,
+			  std::make_shared<Buffer>( threshold ) } ),
+		  worker( [this] { run_jobs(); } ) {}
+
+	ConcurrentKD_Tree( const ConcurrentKD_Tree& ) = delete;
+	ConcurrentKD_Tree& operator=( const ConcurrentKD_Tree& ) = delete;
+	ConcurrentKD_Tree( ConcurrentKD_Tree&& ) = delete;
+	ConcurrentKD_Tree& operator=( ConcurrentKD_Tree&& ) = delete;
+
+	/// Every Snapshot must be destroyed first
+	~ConcurrentKD_Tree() {
+		{
+			const std::lock_guard<std::mutex> lock( jobs );
+			stopping = true;
+		}
+		has_work.notify_one();
+		worker.join();
+		delete current.load();
+	}
+
+	Snapshot snapshot() const { return Snapshot( epochs, current ); }
+
+	/// Queues a tree over input_data to be built on the background thread, then swapped in for
+	/// new snapshots. Points inserted but not yet merged are kept. A queued rebuild that hasn't
+	/// started yet is replaced by a newer one.
+	void rebuild( Input&& input_data ) {
+		{
+			const std::lock_guard<std::mutex> lock( jobs );
+			pending = std::move( input_data );
+		}
+		has_work.notify_one();
+	}
+
+	/// Adds point without blocking other inserters or readers. It's visible to snapshots taken
+	/// after this returns. Once merge_threshold points are buffered a merge is requested, and
+	/// when inserts outrun the merges, or a held Snapshot stalls one, the buffer keeps growing.
+	void insert( DataType point )
+		requires concurrent_detail::IsGrowableInput<Input>
+	{
+		const std::size_t slot = epochs.enter();
+		const std::size_t buffered = current.load()->active->push( std::move( point ) );
+		epochs.leave( slot );
+		if ( buffered >= threshold ) {
+			request_merge();
+		}
+	}
+
+	/// Blocks until queued rebuilds and merges are swapped in and the versions they replaced
+	/// are freed, which never happens while the calling thread holds a Snapshot.
+	void wait() {
+		std::unique_lock<std::mutex> lock( jobs );
+		idle.wait( lock, [&] { return !busy && !pending.has_value() && !merge_requested.load(); } );
+	}
+
+	private:
+	[[no_unique_address]] Aggregate aggregate;
+	[[no_unique_address]] SplitRule split_rule;
+	std::size_t threshold;
+	std::atomic<Version*> current;
+	mutable concurrent_detail::Epochs epochs;
+
+	std::mutex jobs;
+	std::condition_variable has_work;
+	std::condition_variable idle;
+	std::optional<Input> pending;
+	std::atomic<bool> merge_requested = false;
+	bool busy = false;
+	bool stopping = false;
+	std::thread worker;
+
+	void request_merge() {
+		if ( !merge_requested.load( std::memory_order_relaxed ) && !merge_requested.exchange( true ) ) {
+			const std::lock_guard<std::mutex> lock( jobs );
+			has_work.notify_one();
+		}
+	}
+
+	/// Swaps next in and frees the version it replaced once its readers are gone
+	void publish( Version* next ) {
+		Version* previous = current.exchange( next );
+		epochs.synchronize();
+		delete previous;
+	}
+
+	void run_jobs() {
+		std::unique_lock<std::mutex> lock( jobs );
+		while ( true ) {
+			has_work.wait( lock, [&] {
+				return stopping || pending.has_value() || merge_requested.load();
+			} );
+			busy = true;
+			if ( pending.has_value() ) {
+				Input data = std::move( *pending );
+				pending.reset();
+				lock.unlock();
+				const Version* version = current.load();
+				publish( new Version{
+					std::make_shared<const Tree>( std::move( data ), aggregate, split_rule ),
+					version->sealed,
+					version->active } );
+				lock.lock();
+			} else if ( stopping ) {
+				return;
+			} else {
+				lock.unlock();
+				if constexpr ( concurrent_detail::IsGrowableInput<Input> ) {
+					merge();
+				}
+				lock.lock();
+			}
+			busy = false;
+			idle.notify_all();
+		}
+	}
+
+	/// Seals the active buffer behind a fresh one, waits out the inserters still writing to it,
+	/// then builds a tree over the old tree's points and the sealed ones
+	void merge() {
+		merge_requested.store( false );
+		const Version* version = current.load();
+		if ( version->active->size() == 0 ) {
+			return;
+		}
+		publish( new Version{ version->tree, version->active, std::make_shared<Buffer>( threshold ) } );
+		version = current.load();
+
+		Input data;
+		data.reserve( version->tree->size() + version->sealed->size() );
+		collect( version->tree->root_subtree(), data );
+		version->sealed->for_each( [&]( const DataType& point ) { data.push_back( point ); } );
+		publish( new Version{
+			std::make_shared<const Tree>( std::move( data ), aggregate, split_rule ),
+			nullptr,
+			version->active } );
+	}
+
+	static void collect( const typename Tree::Subtree subtree, Input& data ) {
+		if ( !subtree ) {
+			return;
+		}
+		data.push_back( subtree.point() );
+		collect( subtree.left(), data );
+		collect( subtree.right(), data );
+	}
+};
+
+}  // namespace spatial_lib
+
+#endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef KD_TREE_LAYER_OPTIMIZED_HPP_
 #define KD_TREE_LAYER_OPTIMIZED_HPP_
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <concepts>
@@ -88,7 +89,7 @@ class KD_Tree_Base {
 	}
 
 	public:
-	explicit KD_Tree_Base( std::vector<T>& data_vector ){};
+	explicit KD_Tree_Base( std::vector<T>& /* data_vector */ ){};
 
 	void balance_tree( std::vector<T>& data_vector ) { balance_tree( &data_vector ); }
 
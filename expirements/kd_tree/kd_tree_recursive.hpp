@@ -1,6 +1,7 @@
 #ifndef KD_TREE_HPP_
 #define KD_TREE_HPP_
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <concepts>
@@ -170,7 +171,6 @@ template <KDTreeArrayDataConstraint T> class KD_Tree<T> {
 
 		const std::size_t midpoint = start + ( ( end - start ) / 2 );
 		tree_place = presorted_dimensions[depth % dimensions][midpoint];
-		Node* orig_p = tree_place;
 
 		if (tree_place->left != nullptr || tree_place->right != nullptr) {
 			throw "ruh roh";// the presorted dimensions make no sense actually
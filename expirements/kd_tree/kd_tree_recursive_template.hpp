@@ -1,6 +1,7 @@
 #ifndef KD_TREE_RECURSIVE_TEMPLATE_HPP_
 #define KD_TREE_RECURSIVE_TEMPLATE_HPP_
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <concepts>
@@ -1,6 +1,7 @@
 #ifndef KD_TREE_RECURSIVE_VIRTUAL_HPP_
 #define KD_TREE_RECURSIVE_VIRTUAL_HPP_
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <concepts>
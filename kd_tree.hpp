@@ -43,14 +43,31 @@ Construction:
 #ifndef SPATIAL_LIB_KD_TREE_HPP_
 #define SPATIAL_LIB_KD_TREE_HPP_
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
 #include <execution>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <stdexcept>
+#include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
+#ifndef SPATIAL_LIB_DISPATCH_DIMENSIONS
+/// Runtime dimensions from 1 up to this many run queries compiled for that exact count, define
+/// it as 0 before including to keep the build smaller
+#define SPATIAL_LIB_DISPATCH_DIMENSIONS 16
+#endif
+
 namespace spatial_lib {
 
 namespace kd_tree_types {
@@ -71,8 +88,10 @@ template <typename Container> concept InputContainsValidDataTypeNotCArray =
 template <typename Container> concept InputCArrayContainsValidDataType =
 	std::is_array_v<Container> && IsValidCoordinates<decltype(std::remove_all_extents_t<Container>::coordinates)>;
 
-template <typename Container> concept IsDynamicContainer = requires( Container container ) {
-	{ container.push_back( Container::value_type ) } -> std::same_as<void>;
+template <typename Container> concept IsDynamicContainer = requires(
+	Container container, typename Container::value_type value
+) {
+	{ container.push_back( value ) } -> std::same_as<void>;
 };
 
 template <typename Container> concept IsValidInput = (!std::is_lvalue_reference_v<Container>) &&
@@ -80,6 +99,12 @@ template <typename Container> concept IsValidInput = (!std::is_lvalue_reference_
 	( InputCArrayContainsValidDataType<Container> ||
 	  InputContainsValidDataTypeNotCArray<Container> );
 
+/// An input a tree can own, one whose elements live in an allocation that moves along with it.
+/// C arrays and std::array hold theirs inline, so moving a tree that owned one would copy them
+/// and leave its nodes pointing into the moved from tree.
+template <typename Container> concept IsOwnableInput =
+	IsValidInput<Container> && IsDynamicContainer<Container>;
+
 template <typename Container> concept IsStaticContainer =
 	IsContainer<Container> && ( !IsDynamicContainer<Container> );
 
@@ -111,153 +136,3081 @@ constexpr std::size_t staticDimensions<T> =
 template <InputContainsStaticCoordinatesNotCArray T>
 constexpr std::size_t staticDimensions<T> = staticSize<decltype( T::value_type::coordinates )>;
 
-}  // namespace kd_tree_types
+/// Layouts KD_Tree::reorder_input can move an owned input into
+enum class InputOrder : std::uint8_t {
+	/// Depth first order of the tree, each subtree is one contiguous run
+	tree,
+	/// Z order of the coordinates within the tree's bounding box, then rebuilt
+	morton
+};
 
-template <kd_tree_types::IsValidInput Input, typename WrappedInput> class KD_Tree {
+/// What KD_Tree::build_report returns: how long each phase of the last generate_tree took, what
+/// the tree keeps in memory besides the input, and the shape of the tree
+struct BuildReport {
+	struct Phases {
+		/// Creating the nodes and filling the presorted lists with them
+		std::chrono::nanoseconds node_creation{};
+		/// Sorting each dimension's list, by dimension
+		std::vector<std::chrono::nanoseconds> presort;
+		/// Choosing the splits and linking the nodes
+		std::chrono::nanoseconds link{};
+		/// Subtree boxes and aggregates
+		std::chrono::nanoseconds summarize{};
+		std::chrono::nanoseconds total{};
+	};
 
-	WrappedInput input_data;
+	/// Bytes allocated, by capacity rather than size
+	struct Memory {
+		std::size_t nodes = 0;
+		std::size_t presorted = 0;
+		std::size_t subtree_bounds = 0;
+		std::size_t subtree_aggregates = 0;
+		std::size_t quantized = 0;
+		/// Only held while linking, on top of everything else, and freed at the end of the build
+		std::size_t link_scratch = 0;
 
-	using DataType = std::conditional_t<
-		std::is_array_v<Input>,
-		std::remove_all_extents_t<Input>,
-		typename Input::value_type>;
+		/// What the built tree keeps, without link_scratch
+		std::size_t total() const {
+			return nodes + presorted + subtree_bounds + subtree_aggregates + quantized;
+		}
+	};
 
-	struct Node {
-		Node* left;
-		Node* right;
-		DataType* data;
+	struct Shape {
+		/// Levels from the root to the deepest leaf, 0 for an empty tree
+		std::size_t height = 0;
+		/// Nodes at each depth, the root's being 0
+		std::vector<std::size_t> depth_histogram;
+		double mean_depth = 0;
+		/// height over the least height a tree of as many nodes can have, 1 when fully balanced
+		double imbalance = 0;
 	};
 
-	using PresortedContainer = std::conditional_t<
-		kd_tree_types::InputContainsStaticCoordinates<Input>,
-		std::array<std::vector<Node*>, kd_tree_types::staticDimensions<Input>>,
-		std::vector<std::vector<Node*>>>;
+	Phases phases;
+	Memory memory;
+	Shape shape;
+};
 
-	std::vector<Node> nodes;
+}  // namespace kd_tree_types
 
-	Node* root = nullptr;
+namespace kd_tree_metrics {
 
-	std::size_t dimensions = 0;
+/// Metrics are a per-axis term plus a combine step, compared in their "reduced" form (squared for
+/// Euclidean) and only converted with to_distance when a real distance is needed. A single axis
+/// term never exceeds the combined distance, which is what lets a query skip a whole subtree.
+template <typename Metric, typename T> concept IsMetric = requires(
+	const Metric metric, const T value, const std::size_t dim
+) {
+	{ metric.axis( dim, value ) } -> std::convertible_to<T>;
+	{ metric.combine( value, value ) } -> std::convertible_to<T>;
+	{ metric.to_distance( value ) } -> std::convertible_to<T>;
+	{ metric.to_reduced( value ) } -> std::convertible_to<T>;
+};
 
-	PresortedContainer presorted_dimensions;
+/// Full distances for metrics built from axis and combine. When Dimensions is known the loop is
+/// expanded at compile time, otherwise it falls back to the runtime dimensions.
+template <typename Metric> struct AxisMetric {
+	template <std::size_t Dimensions, typename T, typename A, typename B>
+	constexpr T reduced_distance(
+		const A& a, const B& b, const std::size_t dimensions = Dimensions
+	) const {
+		const Metric& metric = static_cast<const Metric&>( *this );
+		T reduced = T( 0 );
+		if constexpr ( Dimensions != 0 ) {
+			[&]<std::size_t... dim>( std::index_sequence<dim...> ) {
+				( ( reduced = metric.combine(
+						reduced, metric.axis( dim, static_cast<T>( a[dim] ) - static_cast<T>( b[dim] ) )
+					) ),
+				  ... );
+			}( std::make_index_sequence<Dimensions>() );
+		} else {
+			for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+				reduced = metric.combine(
+					reduced, metric.axis( dim, static_cast<T>( a[dim] ) - static_cast<T>( b[dim] ) )
+				);
+			}
+		}
+		return reduced;
+	}
 
-	void link_tree(
-		const std::size_t start, const std::size_t end, const std::size_t depth, Node*& tree_place
-	) {
+	template <std::size_t Dimensions, typename T, typename A, typename B>
+	T distance( const A& a, const B& b, const std::size_t dimensions = Dimensions ) const {
+		return static_cast<const Metric&>( *this ).to_distance(
+			reduced_distance<Dimensions, T>( a, b, dimensions )
+		);
+	}
+};
 
-		if ( start == end ) {
-			tree_place = nullptr;
-			return;
+/// L-P distance, reduced to the sum of |difference|^P so no roots are taken while searching.
+template <unsigned int P> struct Minkowski : AxisMetric<Minkowski<P>> {
+	static_assert( P > 0, "Minkowski metrics need a positive order" );
+
+	template <typename T> constexpr T axis( const std::size_t /* dim */, const T difference ) const {
+		if constexpr ( P % 2 == 0 ) {
+			T term = difference * difference;
+			for ( unsigned int i = 2; i < P; i += 2 ) {
+				term *= difference * difference;
+			}
+			return term;
+		} else {
+			const T magnitude = difference < T( 0 ) ? -difference : difference;
+			T term = magnitude;
+			for ( unsigned int i = 1; i < P; i++ ) {
+				term *= magnitude;
+			}
+			return term;
 		}
+	}
 
-		const std::size_t midpoint = start + ( ( end - start ) / 2 );
-		tree_place = get_node_from_presorted_dimensions( depth, midpoint );
+	template <typename T> constexpr T combine( const T reduced, const T term ) const {
+		return reduced + term;
+	}
 
-		link_tree( start, midpoint, depth + 1, tree_place->left );
-		link_tree( midpoint + 1, end, depth + 1, tree_place->right );
+	template <typename T> T to_distance( const T reduced ) const {
+		if constexpr ( P == 1 ) {
+			return reduced;
+		} else if constexpr ( P == 2 ) {
+			return std::sqrt( reduced );
+		} else {
+			return std::pow( reduced, T( 1 ) / static_cast<T>( P ) );
+		}
 	}
 
-	inline void presort_dimension( std::size_t dim ) {
-		std::sort(
-			std::execution::par_unseq,
-			presorted_dimensions[dim].begin(),
-			presorted_dimensions[dim].end(),
-			[dim]( const Node* node1, const Node* node2 ) {
-				return node1->data->coordinates[dim] < node2->data->coordinates[dim];
+	template <typename T> constexpr T to_reduced( const T distance ) const {
+		return axis( 0, distance );
+	}
+};
+
+using Manhattan = Minkowski<1>;
+using Euclidean = Minkowski<2>;
+
+/// L-infinity, the largest difference along any single axis.
+struct Chebyshev : AxisMetric<Chebyshev> {
+	template <typename T> constexpr T axis( const std::size_t /* dim */, const T difference ) const {
+		return difference < T( 0 ) ? -difference : difference;
+	}
+
+	template <typename T> constexpr T combine( const T reduced, const T term ) const {
+		return reduced < term ? term : reduced;
+	}
+
+	template <typename T> constexpr T to_distance( const T reduced ) const { return reduced; }
+
+	template <typename T> constexpr T to_reduced( const T distance ) const { return distance; }
+};
+
+/// Metrics whose axes can wrap around, which queries must bound with axis_to_interval over the
+/// cell a subtree covers rather than with the split plane or the subtree's box.
+template <typename Metric> concept IsPeriodic = requires(
+	const Metric metric, const double value, const std::size_t dim
+) {
+	{ metric.axis_to_interval( dim, value, value, value ) } -> std::convertible_to<double>;
+	{ metric.template period<double>( dim ) } -> std::convertible_to<double>;
+};
+
+/// Scales each axis term of Base by a non-negative weight, so for Euclidean the weight applies to
+/// the squared difference. Use a std::array for Weights to keep the weights a fixed size. A
+/// periodic Base stays periodic, its axis_to_interval weighted the same way.
+template <typename Base = Euclidean, typename Weights = std::vector<double>>
+struct Weighted : AxisMetric<Weighted<Base, Weights>> {
+	Weights weights;  // NOLINT(misc-non-private-member-variables-in-classes)
+	Base base;  // NOLINT(misc-non-private-member-variables-in-classes)
+
+	explicit Weighted( Weights axis_weights, Base base_metric = Base() )
+		: weights( std::move( axis_weights ) ), base( std::move( base_metric ) ) {}
+
+	template <typename T> constexpr T axis( const std::size_t dim, const T difference ) const {
+		return static_cast<T>( weights[dim] ) * base.axis( dim, difference );
+	}
+
+	template <typename T> constexpr T combine( const T reduced, const T term ) const {
+		return base.combine( reduced, term );
+	}
+
+	template <typename T> T to_distance( const T reduced ) const { return base.to_distance( reduced ); }
+
+	template <typename T> constexpr T to_reduced( const T distance ) const {
+		return base.to_reduced( distance );
+	}
+
+	template <typename T>
+	T period( const std::size_t dim ) const
+		requires IsPeriodic<Base>
+	{
+		return base.template period<T>( dim );
+	}
+
+	template <typename T>
+	T axis_to_interval( const std::size_t dim, const T coordinate, const T lower, const T upper ) const
+		requires IsPeriodic<Base>
+	{
+		return static_cast<T>( weights[dim] ) * base.axis_to_interval( dim, coordinate, lower, upper );
+	}
+};
+
+/// Minimum image distances in a box that wraps around on every axis with a non-zero period, axes
+/// with a period of 0 are left open. Coordinates on periodic axes should lie in [0, period).
+template <typename Base = Euclidean, typename Periods = std::vector<double>>
+struct Periodic : AxisMetric<Periodic<Base, Periods>> {
+	Periods periods;  // NOLINT(misc-non-private-member-variables-in-classes)
+	Base base;  // NOLINT(misc-non-private-member-variables-in-classes)
+
+	explicit Periodic( Periods box_periods, Base base_metric = Base() )
+		: periods( std::move( box_periods ) ), base( std::move( base_metric ) ) {}
+
+	template <typename T> T period( const std::size_t dim ) const {
+		return static_cast<T>( periods[dim] );
+	}
+
+	/// The shortest separation between two coordinates on dim, going around the box if shorter
+	template <typename T> T wrap( const std::size_t dim, const T difference ) const {
+		const T size = period<T>( dim );
+		T magnitude = difference < T( 0 ) ? -difference : difference;
+		if ( size > T( 0 ) ) {
+			magnitude = std::fmod( magnitude, size );
+			if ( magnitude > size / 2 ) {
+				magnitude = size - magnitude;
 			}
+		}
+		return magnitude;
+	}
+
+	template <typename T> T axis( const std::size_t dim, const T difference ) const {
+		return base.axis( dim, wrap( dim, difference ) );
+	}
+
+	template <typename T> constexpr T combine( const T reduced, const T term ) const {
+		return base.combine( reduced, term );
+	}
+
+	template <typename T> T to_distance( const T reduced ) const { return base.to_distance( reduced ); }
+
+	template <typename T> constexpr T to_reduced( const T distance ) const {
+		return base.to_reduced( distance );
+	}
+
+	/// The axis term from coordinate to the closest point of [lower, upper] on dim. Queries use
+	/// this instead of the split plane alone, whose far side wraps back around toward the point.
+	template <typename T>
+	T axis_to_interval( const std::size_t dim, T coordinate, const T lower, const T upper ) const {
+		const T size = period<T>( dim );
+		if ( size > T( 0 ) ) {
+			coordinate -= size * std::floor( coordinate / size );
+		}
+		if ( coordinate >= lower && coordinate <= upper ) {
+			return T( 0 );
+		}
+		if ( size <= T( 0 ) ) {
+			return base.axis( dim, coordinate < lower ? lower - coordinate : coordinate - upper );
+		}
+		return base.axis(
+			dim, std::min( wrap( dim, coordinate - lower ), wrap( dim, coordinate - upper ) )
 		);
 	}
+};
 
-	public:
-	/// Only pass a pointer to the KD Tree if you're sure that input_data will be preserved
-	/// in scope for the lifetime of the KD Tree.
-	explicit KD_Tree( std::shared_ptr<Input> input_data ) noexcept : input_data(input_data) { generate_tree( this->input_data.get() ); }
+}  // namespace kd_tree_metrics
+
+namespace kd_tree_kernels {
+
+/// Kernel profiles for kernel_density, taking distance / bandwidth. They must not increase with
+/// distance, which is what lets a subtree's contribution be bounded by its nearest and furthest
+/// box corners. Neither is normalized, scale by the kernel's constant / bandwidth^d for a
+/// probability density.
+struct Gaussian {
+	template <typename T> T operator()( const T scaled_distance ) const {
+		return std::exp( -( scaled_distance * scaled_distance ) / T( 2 ) );
+	}
+};
 
-	/// Passing by value leads to the value being moved, this should only be done to preserve
-	/// the input_data if it would otherwise go out of scope.
-	explicit KD_Tree( Input&& input_data ) noexcept : input_data(std::move(input_data)) {
-		generate_tree( &(this->input_data) );
+struct Epanechnikov {
+	template <typename T> constexpr T operator()( const T scaled_distance ) const {
+		return scaled_distance < T( 1 ) ? T( 1 ) - ( scaled_distance * scaled_distance ) : T( 0 );
 	}
+};
 
-	void generate_tree( Input* data_container = nullptr ) {
-		if constexpr ( kd_tree_types::InputContainsStaticCoordinates<Input> ) {
-			dimensions = kd_tree_types::staticDimensions<Input>;
-		} else if ( data_container != nullptr && !data_container->empty() ) {
-			dimensions = ( *data_container )[0].coordinates.size();
+}  // namespace kd_tree_kernels
+
+namespace kd_tree_aggregates {
+
+/// A monoid over the tree's data: value_type with an identity, a lift from a single point and an
+/// associative combine. The tree keeps one value per subtree so range queries can take whole
+/// subtrees at once instead of visiting their points.
+template <typename Aggregate, typename DataType> concept IsAggregate = requires(
+	const Aggregate aggregate, const DataType& data, const typename Aggregate::value_type value
+) {
+	{ aggregate.identity() } -> std::convertible_to<typename Aggregate::value_type>;
+	{ aggregate.lift( data ) } -> std::convertible_to<typename Aggregate::value_type>;
+	{ aggregate.combine( value, value ) } -> std::convertible_to<typename Aggregate::value_type>;
+};
+
+/// The default, nothing is stored per node
+struct None {};
+
+struct Count {
+	using value_type = std::size_t;
+
+	value_type identity() const { return 0; }
+
+	template <typename DataType> value_type lift( const DataType& /* data */ ) const { return 1; }
+
+	value_type combine( const value_type a, const value_type b ) const { return a + b; }
+};
+
+/// Projection is called on each point's data for the value to aggregate, for example
+/// Sum<decltype( []( const Point& point ) { return point.weight; } )>
+template <typename Projection, typename T = double> struct Sum {
+	using value_type = T;
+	[[no_unique_address]] Projection projection;  // NOLINT(misc-non-private-member-variables-in-classes)
+
+	value_type identity() const { return T( 0 ); }
+
+	template <typename DataType> value_type lift( const DataType& data ) const {
+		return static_cast<T>( projection( data ) );
+	}
+
+	value_type combine( const value_type a, const value_type b ) const { return a + b; }
+};
+
+template <typename Projection, typename T = double> struct Min {
+	using value_type = T;
+	[[no_unique_address]] Projection projection;  // NOLINT(misc-non-private-member-variables-in-classes)
+
+	value_type identity() const { return std::numeric_limits<T>::max(); }
+
+	template <typename DataType> value_type lift( const DataType& data ) const {
+		return static_cast<T>( projection( data ) );
+	}
+
+	value_type combine( const value_type a, const value_type b ) const { return std::min( a, b ); }
+};
+
+template <typename Projection, typename T = double> struct Max {
+	using value_type = T;
+	[[no_unique_address]] Projection projection;  // NOLINT(misc-non-private-member-variables-in-classes)
+
+	value_type identity() const { return std::numeric_limits<T>::lowest(); }
+
+	template <typename DataType> value_type lift( const DataType& data ) const {
+		return static_cast<T>( projection( data ) );
+	}
+
+	value_type combine( const value_type a, const value_type b ) const { return std::max( a, b ); }
+};
+
+/// Each coordinate summed as a double, a subtree's centroid is its sum over its size. Dimensions
+/// is 0 when the coordinates are only sized at runtime, the sum is then a vector.
+template <std::size_t Dimensions = 0> struct CoordinateSum {
+	using value_type = std::conditional_t<
+		Dimensions == 0,
+		std::vector<double>,
+		std::array<double, Dimensions>>;
+
+	value_type identity() const { return value_type{}; }
+
+	template <typename DataType> value_type lift( const DataType& data ) const {
+		value_type sum{};
+		if constexpr ( Dimensions == 0 ) {
+			sum.resize( data.coordinates.size() );
 		}
-		std::size_t total_size = nodes.size();
-		if constexpr ( std::is_array_v<Input> ) {
-			total_size += std::extent_v<Input>;
-		} else {
-			total_size += data_container->size();
+		for ( std::size_t dim = 0; dim < sum.size(); dim++ ) {
+			sum[dim] = static_cast<double>( data.coordinates[dim] );
 		}
+		return sum;
+	}
 
-		// reserve the space for all the data in the presorted dimensions
-		nodes.reserve( total_size );
-		if constexpr ( kd_tree_types::InputContainsStaticCoordinates<Input> ) {
-			for ( std::size_t i = 0; i < kd_tree_types::staticDimensions<Input>; i++ ) {
-				presorted_dimensions[i].reserve( total_size );
+	value_type combine( value_type a, const value_type& b ) const {
+		if ( a.empty() ) {
+			return b;
+		}
+		for ( std::size_t dim = 0; dim < b.size(); dim++ ) {
+			a[dim] += b[dim];
+		}
+		return a;
+	}
+};
+
+}  // namespace kd_tree_aggregates
+
+namespace kd_tree_splits {
+
+/// Where a node's points are split: along dimension, at the point offset places into that
+/// dimension's sorted order. That point becomes the node and the points before it go left.
+struct Split {
+	std::size_t dimension;
+	std::size_t offset;
+};
+
+/// A split rule is asked to choose a Split for each node's points. The range it's given has
+/// size(), dimensions(), depth(), coordinate( dim, offset ) in ascending order along dim, and
+/// lower( dim ) / upper( dim ) of the node's cell, the region left to it by the splits above
+/// inside the bounding box of all the points. Rules with cyclic set always split on
+/// depth % dimensions, so nodes don't need to store their split dimension.
+template <typename Rule> concept IsSplitRule = requires { { Rule::cyclic } -> std::convertible_to<bool>; };
+
+/// The median of depth % dimensions, the default
+struct CyclicMedian {
+	static constexpr bool cyclic = true;
+
+	template <typename Range> Split choose( const Range& range ) const {
+		return { range.depth() % range.dimensions(), range.size() / 2 };
+	}
+};
+
+/// The median of the dimension the points are most spread out along
+struct WidestSpread {
+	static constexpr bool cyclic = false;
+
+	template <typename Range> static std::size_t widest( const Range& range ) {
+		std::size_t widest_dimension = 0;
+		double widest_spread = -1.0;
+		for ( std::size_t dim = 0; dim < range.dimensions(); dim++ ) {
+			const double spread = static_cast<double>( range.coordinate( dim, range.size() - 1 ) ) -
+				static_cast<double>( range.coordinate( dim, 0 ) );
+			if ( spread > widest_spread ) {
+				widest_spread = spread;
+				widest_dimension = dim;
 			}
-		} else {
-			// reserve a vector for every dimension
-			presorted_dimensions.reserve( dimensions );
-			for ( std::size_t i = 0; i < dimensions; i++ ) {
-				presorted_dimensions.emplace_back();
-				presorted_dimensions[i].reserve( total_size );
+		}
+		return widest_dimension;
+	}
+
+	template <typename Range> Split choose( const Range& range ) const {
+		return { widest( range ), range.size() / 2 };
+	}
+};
+
+/// Maneewongvatana and Mount's sliding midpoint, adapted to a point at every node: the cell's
+/// longest side is split at the point closest to its midpoint, which slides the split onto the
+/// nearest point when the midpoint has none on one side. Cells stay fat instead of the skinny
+/// cells medians make on uneven data. The split is kept within the middle balance share of
+/// the points, so a run of slides can't make the tree deep. A balance of 0 or less always takes
+/// the median, and balances above max_balance are taken as max_balance.
+struct SlidingMidpoint {
+	static constexpr bool cyclic = false;
+	/// Each child keeps at most ( 1 + max_balance ) / 2 of the points, closer to 1 a slide could
+	/// peel a single point off every level and make the depth linear
+	static constexpr double max_balance = 0.9;
+	double balance = 0.75;
+
+	template <typename Range> Split choose( const Range& range ) const {
+		std::size_t dimension = 0;
+		double longest = -1.0;
+		for ( std::size_t dim = 0; dim < range.dimensions(); dim++ ) {
+			const double side = static_cast<double>( range.upper( dim ) - range.lower( dim ) );
+			if ( side > longest ) {
+				longest = side;
+				dimension = dim;
 			}
 		}
+		if ( !( longest > 0.0 ) ) {
+			dimension = WidestSpread::widest( range );
+		}
+		const double midpoint =
+			( static_cast<double>( range.lower( dimension ) ) + static_cast<double>( range.upper( dimension ) ) ) / 2;
 
-		// add existing nodes to the presorted vectors
-		for ( Node& node : nodes ) {
-			for ( std::vector<Node*>& presorted_dim : presorted_dimensions ) {
-				presorted_dim.emplace_back( &node );
+		// first point at or past the midpoint, then whichever neighbour of it is closer
+		std::size_t first = 0;
+		std::size_t last = range.size();
+		while ( first < last ) {
+			const std::size_t middle = first + ( ( last - first ) / 2 );
+			if ( static_cast<double>( range.coordinate( dimension, middle ) ) < midpoint ) {
+				first = middle + 1;
+			} else {
+				last = middle;
 			}
 		}
+		std::size_t offset = std::min( first, range.size() - 1 );
+		if ( offset > 0 && midpoint - static_cast<double>( range.coordinate( dimension, offset - 1 ) ) <
+							   static_cast<double>( range.coordinate( dimension, offset ) ) - midpoint ) {
+			offset--;
+		}
+		// at most the median, so the clamp's bounds can't cross on small nodes
+		const std::size_t margin = std::min(
+			static_cast<std::size_t>(
+				static_cast<double>( range.size() ) * std::clamp( 1.0 - balance, 1.0 - max_balance, 1.0 ) / 2
+			),
+			( range.size() - 1 ) / 2
+		);
+		return { dimension, std::clamp( offset, margin, range.size() - 1 - margin ) };
+	}
+};
 
-		// add the new nodes in the data vector to both nodes and presorteds
-		if ( data_container != nullptr ) {
-			for ( DataType& data : *data_container ) {
-				nodes.emplace_back( nullptr, nullptr, &data );
-				for ( std::vector<Node*>& presorted_dim : presorted_dimensions ) {
-					presorted_dim.emplace_back( &nodes.back() );
+/// Picks the split with the lowest expected query cost, in the spirit of the surface area
+/// heuristic. A query reaching query_reach past a child's cell is counted as visiting it, so
+/// each side costs its point count times its cell width along the split plus twice the reach.
+/// Splits that cut off empty space or the long side of a flat cell are cheap. A query_reach of
+/// 0 uses the spacing the points would have spread evenly over the cell. Only candidates
+/// evenly spaced ranks are tried per dimension, which also keeps the tree's depth logarithmic.
+struct CostModel {
+	static constexpr bool cyclic = false;
+	double query_reach = 0.0;
+	std::size_t candidates = 15;
+
+	template <typename Range> Split choose( const Range& range ) const {
+		double reach = query_reach;
+		if ( !( reach > 0.0 ) ) {
+			double volume = 1.0;
+			std::size_t sides = 0;
+			for ( std::size_t dim = 0; dim < range.dimensions(); dim++ ) {
+				const double side = static_cast<double>( range.upper( dim ) - range.lower( dim ) );
+				if ( side > 0.0 ) {
+					volume *= side;
+					sides++;
 				}
 			}
+			reach = sides == 0 ? 0.0
+							   : std::pow( volume / static_cast<double>( range.size() ),
+										   1.0 / static_cast<double>( sides ) );
 		}
 
-		// actually sort the presorted dimensions
-		if constexpr ( kd_tree_types::InputContainsStaticCoordinates<Input> ) {
-			for ( std::size_t dim = 0; dim < kd_tree_types::staticDimensions<Input>; dim++ ) {
-				presort_dimension( dim );
+		Split best = { range.depth() % range.dimensions(), range.size() / 2 };
+		double best_cost = std::numeric_limits<double>::max();
+		for ( std::size_t dim = 0; dim < range.dimensions(); dim++ ) {
+			const auto lower = static_cast<double>( range.lower( dim ) );
+			const auto upper = static_cast<double>( range.upper( dim ) );
+			if ( !( upper > lower ) ) {
+				continue;
 			}
-		} else {
-			for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
-				presort_dimension( dim );
+			for ( std::size_t candidate = 1; candidate <= candidates; candidate++ ) {
+				const std::size_t offset = candidate * range.size() / ( candidates + 1 );
+				const auto split = static_cast<double>( range.coordinate( dim, offset ) );
+				const double cost = ( ( static_cast<double>( offset ) * ( split - lower + ( 2 * reach ) ) ) +
+									  ( static_cast<double>( range.size() - offset - 1 ) *
+										( upper - split + ( 2 * reach ) ) ) ) /
+					( upper - lower + ( 2 * reach ) );
+				if ( cost < best_cost ) {
+					best_cost = cost;
+					best = { dim, offset };
+				}
 			}
 		}
-		link_tree( 0, total_size, 0, root );
+		return best;
 	}
+};
 
-	Node* nearest_neighbor( /* const std::vector<CoordinatesType>& coordinates */ ) {
-		if ( root == nullptr ) {
-			return nullptr;
+}  // namespace kd_tree_splits
+
+namespace kd_tree_stats {
+
+/// What a query's traversal cost, for explaining latency from the shape of the data
+struct QueryStats {
+	/// Nodes the search reached, including those it then pruned by their box
+	std::size_t nodes_visited = 0;
+	/// Visited leaves whose point was measured
+	std::size_t leaves_scanned = 0;
+	/// Distances measured to points, including rerankings of quantized candidates
+	std::size_t distance_evaluations = 0;
+	/// Subtrees skipped by their box or split plane
+	std::size_t pruned_subtrees = 0;
+	/// Deepest recursion of the search, the root being 1
+	std::size_t max_depth = 0;
+
+	QueryStats& operator+=( const QueryStats& other ) {
+		nodes_visited += other.nodes_visited;
+		leaves_scanned += other.leaves_scanned;
+		distance_evaluations += other.distance_evaluations;
+		pruned_subtrees += other.pruned_subtrees;
+		max_depth = std::max( max_depth, other.max_depth );
+		return *this;
+	}
+};
+
+/// A policy recording every query's QueryStats. record is called once per query from whichever
+/// thread ran it, so it has to be safe to call concurrently.
+template <typename Stats> concept IsStats = requires( const Stats stats, const QueryStats query ) {
+	{ Stats::enabled } -> std::convertible_to<bool>;
+	stats.record( query );
+};
+
+/// The default, queries are compiled without any counting
+struct None {
+	static constexpr bool enabled = false;
+
+	void record( const QueryStats& /* query */ ) const {}
+};
+
+/// Running totals over every query, and the last query of each thread. Copies share the totals,
+/// so keeping a copy of the one given to a tree is enough to read them.
+class Counting {
+	struct Totals {
+		std::atomic<std::size_t> queries = 0;
+		std::atomic<std::size_t> nodes_visited = 0;
+		std::atomic<std::size_t> leaves_scanned = 0;
+		std::atomic<std::size_t> distance_evaluations = 0;
+		std::atomic<std::size_t> pruned_subtrees = 0;
+		std::atomic<std::size_t> max_depth = 0;
+	};
+
+	std::shared_ptr<Totals> totals = std::make_shared<Totals>();
+
+	static QueryStats& last_of_thread() {
+		thread_local QueryStats last;
+		return last;
+	}
+
+	public:
+	static constexpr bool enabled = true;
+
+	void record( const QueryStats& query ) const {
+		last_of_thread() = query;
+		totals->queries.fetch_add( 1, std::memory_order_relaxed );
+		totals->nodes_visited.fetch_add( query.nodes_visited, std::memory_order_relaxed );
+		totals->leaves_scanned.fetch_add( query.leaves_scanned, std::memory_order_relaxed );
+		totals->distance_evaluations.fetch_add(
+			query.distance_evaluations, std::memory_order_relaxed
+		);
+		totals->pruned_subtrees.fetch_add( query.pruned_subtrees, std::memory_order_relaxed );
+		std::size_t deepest = totals->max_depth.load( std::memory_order_relaxed );
+		while ( deepest < query.max_depth &&
+				!totals->max_depth.compare_exchange_weak(
+					deepest, query.max_depth, std::memory_order_relaxed
+				) ) {
 		}
-		return root;
 	}
 
-	inline Node* get_node_from_presorted_dimensions( std::size_t depth, std::size_t index ) {
+	std::size_t queries() const { return totals->queries.load( std::memory_order_relaxed ); }
+
+	/// Every query's counts added up, with the deepest max_depth of any
+	QueryStats total() const {
+		return { totals->nodes_visited.load( std::memory_order_relaxed ),
+				 totals->leaves_scanned.load( std::memory_order_relaxed ),
+				 totals->distance_evaluations.load( std::memory_order_relaxed ),
+				 totals->pruned_subtrees.load( std::memory_order_relaxed ),
+				 totals->max_depth.load( std::memory_order_relaxed ) };
+	}
+
+	/// The most recent query the calling thread ran on any tree counting with Counting
+	static QueryStats last() { return last_of_thread(); }
+
+	/// Not atomic with queries running at the same time, which may land on either side of it
+	void reset() const {
+		totals->queries.store( 0, std::memory_order_relaxed );
+		totals->nodes_visited.store( 0, std::memory_order_relaxed );
+		totals->leaves_scanned.store( 0, std::memory_order_relaxed );
+		totals->distance_evaluations.store( 0, std::memory_order_relaxed );
+		totals->pruned_subtrees.store( 0, std::memory_order_relaxed );
+		totals->max_depth.store( 0, std::memory_order_relaxed );
+	}
+};
+
+}  // namespace kd_tree_stats
+
+template <
+	kd_tree_types::IsValidInput Input,
+	typename WrappedInput,
+	typename Aggregate = kd_tree_aggregates::None,
+	kd_tree_splits::IsSplitRule SplitRule = kd_tree_splits::CyclicMedian,
+	kd_tree_stats::IsStats Stats = kd_tree_stats::None>
+class KD_Tree {
+
+	// joins reach into the nodes and bounds of trees over other inputs
+	template <
+		kd_tree_types::IsValidInput OtherInput,
+		typename OtherWrappedInput,
+		typename OtherAggregate,
+		kd_tree_splits::IsSplitRule OtherSplitRule,
+		kd_tree_stats::IsStats OtherStats>
+	friend class KD_Tree;
+
+	WrappedInput input_data;
+
+	public:
+	using DataType = std::conditional_t<
+		std::is_array_v<Input>,
+		std::remove_all_extents_t<Input>,
+		typename Input::value_type>;
+
+	using CoordinatesType = decltype( DataType::coordinates );
+
+	using CoordinateType =
+		std::remove_cvref_t<decltype( std::declval<const CoordinatesType&>()[0] )>;
+
+	/// Integral coordinates are measured in double so that squared terms can't overflow
+	using DistanceType = std::conditional_t<
+		std::is_floating_point_v<CoordinateType>,
+		CoordinateType,
+		double>;
+
+	private:
+	static constexpr bool stores_split_dimension = !SplitRule::cyclic;
+
+	struct NoSplitDimension {};
+
+	struct Node {
+		Node* left;
+		Node* right;
+		DataType* data;
+		std::size_t subtree_size;
+		[[no_unique_address]] std::conditional_t<stores_split_dimension, std::size_t, NoSplitDimension>
+			split_dimension;
+	};
+
+	static constexpr bool has_aggregate = !std::is_same_v<Aggregate, kd_tree_aggregates::None>;
+
+	static_assert(
+		!has_aggregate || kd_tree_aggregates::IsAggregate<Aggregate, DataType>,
+		"Aggregate needs value_type, identity, lift and combine"
+	);
+
+	struct NoAggregateValue {
+		using value_type = std::size_t;
+	};
+
+	using AggregateValue =
+		typename std::conditional_t<has_aggregate, Aggregate, NoAggregateValue>::value_type;
+
+	[[no_unique_address]] Aggregate aggregate;
+
+	[[no_unique_address]] SplitRule split_rule;
+
+	[[no_unique_address]] Stats stats;
+
+	/// Zero when the dimensions are only known at runtime
+	static constexpr std::size_t static_dimensions = [] {
 		if constexpr ( kd_tree_types::InputContainsStaticCoordinates<Input> ) {
-			return presorted_dimensions[depth % kd_tree_types::staticDimensions<Input>][index];
+			return kd_tree_types::staticDimensions<Input>;
 		} else {
-			return presorted_dimensions[depth % dimensions][index];
+			return std::size_t( 0 );
 		}
-	}
-};
+	}();
 
-template<kd_tree_types::IsValidInput Input>
-KD_Tree(Input&& input_data) -> KD_Tree<Input, Input&&>;
+	using PresortedContainer = std::conditional_t<
+		kd_tree_types::InputContainsStaticCoordinates<Input>,
+		std::array<std::vector<Node*>, static_dimensions>,
+		std::vector<std::vector<Node*>>>;
 
-template<kd_tree_types::IsValidInput Input>
-KD_Tree(std::shared_ptr<Input> input_data) -> KD_Tree<Input, std::shared_ptr<Input>>;
+	using DistanceArray = std::conditional_t<
+		kd_tree_types::InputContainsStaticCoordinates<Input>,
+		std::array<DistanceType, static_dimensions>,
+		std::vector<DistanceType>>;
+
+	/// The region of space a subtree can occupy, narrowed by each split on the way down
+	struct Cell {
+		DistanceArray lower;
+		DistanceArray upper;
+	};
+
+	std::vector<Node> nodes;
+
+	Node* root = nullptr;
+
+	std::size_t dimensions = 0;
+
+	PresortedContainer presorted_dimensions;
+
+	// only used while linking, released at the end of generate_tree
+	std::vector<Node*> partition_scratch;
+	std::vector<std::uint8_t> partition_goes_left;
+
+	/// Bounding box of every subtree by node index, the lower corner followed by the upper corner
+	std::vector<CoordinateType> subtree_bounds;
+
+	/// Aggregate of every subtree by node index, empty without an Aggregate
+	std::vector<AggregateValue> subtree_aggregates;
+
+	/// Timings of the last generate_tree, for build_report
+	kd_tree_types::BuildReport::Phases build_phases;
+
+	/// 16 bit copy of every coordinate by node index, spread over the root's box, empty until
+	/// quantize is called
+	std::vector<std::uint16_t> quantized_coordinates;
+	DistanceArray quantized_origin{};
+	DistanceArray quantized_step{};
+	/// How far a dequantized coordinate can be from the original: half a step, plus the error of
+	/// rounding to a step and of dequantize, both relative to the magnitudes along the axis
+	DistanceArray quantized_slack{};
+	/// Bound on the relative rounding error of a difference from the query, which the exact
+	/// distances the candidates are reranked by also carry
+	static constexpr DistanceType quantized_relative_error =
+		4 * std::numeric_limits<DistanceType>::epsilon();
+
+	struct Neighbor {
+		DistanceType reduced;
+		DataType* data;
+
+		bool operator<( const Neighbor& other ) const { return reduced < other.reduced; }
+	};
+
+	struct NearestCollector {
+		Neighbor best = { std::numeric_limits<DistanceType>::max(), nullptr };
+
+		DistanceType bound() const { return best.reduced; }
+
+		void add( const DistanceType reduced, const Node* node ) {
+			if ( reduced < best.reduced ) {
+				best = { reduced, node->data };
+			}
+		}
+	};
+
+	/// Max heap of the k closest so far, the front is the one to evict
+	struct KNearestCollector {
+		std::size_t k;
+		std::vector<Neighbor> heap;
+
+		/// Nothing can get in when k is 0, so that bound prunes everything
+		DistanceType bound() const {
+			if ( k == 0 ) {
+				return std::numeric_limits<DistanceType>::lowest();
+			}
+			if ( heap.size() < k ) {
+				return std::numeric_limits<DistanceType>::max();
+			}
+			return heap.front().reduced;
+		}
+
+		void add( const DistanceType reduced, const Node* node ) {
+			if ( heap.size() < k ) {
+				heap.push_back( { reduced, node->data } );
+				std::push_heap( heap.begin(), heap.end() );
+			} else if ( k != 0 && reduced < heap.front().reduced ) {
+				std::pop_heap( heap.begin(), heap.end() );
+				heap.back() = { reduced, node->data };
+				std::push_heap( heap.begin(), heap.end() );
+			}
+		}
+	};
+
+	struct RadiusCollector {
+		DistanceType reduced_radius;
+		std::vector<DataType*> found;
+
+		DistanceType bound() const { return reduced_radius; }
+
+		void add( const DistanceType reduced, const Node* node ) {
+			if ( reduced <= reduced_radius ) {
+				found.push_back( node->data );
+			}
+		}
+	};
+
+	/// Hands every node within the radius to emit, used to stream pairs out of the joins
+	template <typename Emit> struct EmitCollector {
+		DistanceType reduced_radius;
+		Emit emit;
+
+		DistanceType bound() const { return reduced_radius; }
+
+		template <typename AnyNode> void add( const DistanceType reduced, const AnyNode* node ) {
+			if ( reduced <= reduced_radius ) {
+				emit( node );
+			}
+		}
+	};
+
+	/// k candidate slots per tree point for all_nearest_neighbors, each kept as a max heap, and
+	/// the largest candidate bound within each subtree for pruning whole node pairs.
+	struct NeighborGraph {
+		std::size_t k;
+		std::vector<Neighbor> candidates;
+		std::vector<std::size_t> counts;
+		std::vector<DistanceType> subtree_bound;
+
+		DistanceType point_bound( const std::size_t index ) const {
+			return counts[index] < k ? std::numeric_limits<DistanceType>::max()
+									 : candidates[index * k].reduced;
+		}
+
+		void add( const std::size_t index, const DistanceType reduced, DataType* data ) {
+			Neighbor* heap = candidates.data() + ( index * k );
+			std::size_t& count = counts[index];
+			if ( count < k ) {
+				heap[count++] = { reduced, data };
+				std::push_heap( heap, heap + count );
+			} else if ( k != 0 && reduced < heap[0].reduced ) {
+				std::pop_heap( heap, heap + k );
+				heap[k - 1] = { reduced, data };
+				std::push_heap( heap, heap + k );
+			}
+		}
+	};
+
+	/// Feeds a single tree search for one tree point into its row of a NeighborGraph
+	struct GraphCollector {
+		NeighborGraph* graph;
+		std::size_t index;
+		const DataType* self;
+
+		DistanceType bound() const { return graph->point_bound( index ); }
+
+		void add( const DistanceType reduced, const Node* node ) {
+			if ( node->data != self ) {
+				graph->add( index, reduced, node->data );
+			}
+		}
+	};
+
+	template <std::size_t Dimensions> inline std::size_t dimension_count() const {
+		if constexpr ( Dimensions != 0 ) {
+			return Dimensions;
+		} else {
+			return dimensions;
+		}
+	}
+
+	/// Returns function.template operator()<D>() for the compile time dimensions D of the tree.
+	/// Runtime dimensions are switched on once here, so up to SPATIAL_LIB_DISPATCH_DIMENSIONS
+	/// they get loops of a fixed length and above it D is 0 for the runtime count.
+	template <std::size_t Dimensions = 1, typename Function>
+	decltype( auto ) with_dimensions( Function&& function ) const {
+		if constexpr ( static_dimensions != 0 ) {
+			return function.template operator()<static_dimensions>();
+		} else if constexpr ( Dimensions > SPATIAL_LIB_DISPATCH_DIMENSIONS ) {
+			return function.template operator()<0>();
+		} else {
+			if ( dimensions == Dimensions ) {
+				return function.template operator()<Dimensions>();
+			}
+			return with_dimensions<Dimensions + 1>( std::forward<Function>( function ) );
+		}
+	}
+
+	inline std::size_t node_index( const Node* node ) const {
+		return static_cast<std::size_t>( node - nodes.data() );
+	}
+
+	/// Splits every other dimension's range around the median of the split dimension, so both
+	/// child ranges hold the same nodes in every dimension and stay sorted.
+	void partition_presorted_dimensions(
+		const std::size_t start,
+		const std::size_t end,
+		const std::size_t midpoint,
+		const std::size_t split_dimension
+	) {
+		const std::vector<Node*>& split_presorted = presorted_dimensions[split_dimension];
+		Node* const median = split_presorted[midpoint];
+		for ( std::size_t i = start; i < end; i++ ) {
+			partition_goes_left[node_index( split_presorted[i] )] =
+				static_cast<std::uint8_t>( i < midpoint );
+		}
+
+		for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+			if ( dim == split_dimension ) {
+				continue;
+			}
+			std::vector<Node*>& presorted = presorted_dimensions[dim];
+			std::size_t left = start;
+			std::size_t right = midpoint + 1;
+			for ( std::size_t i = start; i < end; i++ ) {
+				Node* node = presorted[i];
+				if ( node == median ) {
+					continue;
+				}
+				if ( partition_goes_left[node_index( node )] != 0 ) {
+					partition_scratch[left++] = node;
+				} else {
+					partition_scratch[right++] = node;
+				}
+			}
+			partition_scratch[midpoint] = median;
+			for ( std::size_t i = start; i < end; i++ ) {
+				presorted[i] = partition_scratch[i];
+			}
+		}
+	}
+
+	/// The points of one node while linking, as the split rule sees them
+	class SplitRange {
+		const KD_Tree& tree;
+		std::size_t start;
+		std::size_t end;
+		std::size_t node_depth;
+		const Cell& cell;
+
+		public:
+		SplitRange(
+			const KD_Tree& owner,
+			const std::size_t range_start,
+			const std::size_t range_end,
+			const std::size_t range_depth,
+			const Cell& range_cell
+		)
+			: tree( owner ), start( range_start ), end( range_end ), node_depth( range_depth ), cell( range_cell ) {}
+
+		std::size_t size() const { return end - start; }
+
+		std::size_t dimensions() const { return tree.dimensions; }
+
+		std::size_t depth() const { return node_depth; }
+
+		CoordinateType coordinate( const std::size_t dim, const std::size_t offset ) const {
+			return tree.presorted_dimensions[dim][start + offset]->data->coordinates[dim];
+		}
+
+		DistanceType lower( const std::size_t dim ) const { return cell.lower[dim]; }
+
+		DistanceType upper( const std::size_t dim ) const { return cell.upper[dim]; }
+	};
+
+	void link_tree(
+		const std::size_t start,
+		const std::size_t end,
+		const std::size_t depth,
+		Node*& tree_place,
+		Cell& cell
+	) {
+
+		if ( start == end ) {
+			tree_place = nullptr;
+			return;
+		}
+
+		const kd_tree_splits::Split split =
+			split_rule.choose( SplitRange( *this, start, end, depth, cell ) );
+		const std::size_t midpoint = start + split.offset;
+		tree_place = presorted_dimensions[split.dimension][midpoint];
+		tree_place->subtree_size = end - start;
+		if constexpr ( stores_split_dimension ) {
+			tree_place->split_dimension = split.dimension;
+		}
+		if ( end - start > 1 ) {
+			partition_presorted_dimensions( start, end, midpoint, split.dimension );
+		}
+
+		const DistanceType split_value =
+			static_cast<DistanceType>( tree_place->data->coordinates[split.dimension] );
+		const DistanceType upper = cell.upper[split.dimension];
+		cell.upper[split.dimension] = split_value;
+		link_tree( start, midpoint, depth + 1, tree_place->left, cell );
+		cell.upper[split.dimension] = upper;
+		const DistanceType lower = cell.lower[split.dimension];
+		cell.lower[split.dimension] = split_value;
+		link_tree( midpoint + 1, end, depth + 1, tree_place->right, cell );
+		cell.lower[split.dimension] = lower;
+	}
+
+	/// The dimension node splits its subtree on
+	template <std::size_t Dimensions>
+	inline std::size_t split_dimension( const Node* node, const std::size_t depth ) const {
+		if constexpr ( stores_split_dimension ) {
+			return node->split_dimension;
+		} else {
+			return depth % dimension_count<Dimensions>();
+		}
+	}
+
+	inline const CoordinateType* subtree_lower( const Node* node ) const {
+		return subtree_bounds.data() + ( node_index( node ) * 2 * dimensions );
+	}
+
+	inline const CoordinateType* subtree_upper( const Node* node ) const {
+		return subtree_lower( node ) + dimensions;
+	}
+
+	/// Fills in the bounding box, and the aggregate if there is one, of each subtree bottom up
+	void summarize_tree( const Node* node ) {
+		const std::size_t index = node_index( node );
+		CoordinateType* lower = subtree_bounds.data() + ( index * 2 * dimensions );
+		CoordinateType* upper = lower + dimensions;
+		for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+			lower[dim] = node->data->coordinates[dim];
+			upper[dim] = node->data->coordinates[dim];
+		}
+		if constexpr ( has_aggregate ) {
+			subtree_aggregates[index] = aggregate.lift( *node->data );
+		}
+		for ( const Node* child : { node->left, node->right } ) {
+			if ( child == nullptr ) {
+				continue;
+			}
+			summarize_tree( child );
+			if constexpr ( has_aggregate ) {
+				subtree_aggregates[index] =
+					aggregate.combine( subtree_aggregates[index], subtree_aggregates[node_index( child )] );
+			}
+			const CoordinateType* child_lower = subtree_lower( child );
+			const CoordinateType* child_upper = subtree_upper( child );
+			for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+				lower[dim] = std::min( lower[dim], child_lower[dim] );
+				upper[dim] = std::max( upper[dim], child_upper[dim] );
+			}
+		}
+	}
+
+	inline void presort_dimension( std::size_t dim ) {
+		std::sort(
+			std::execution::par_unseq,
+			presorted_dimensions[dim].begin(),
+			presorted_dimensions[dim].end(),
+			[dim]( const Node* node1, const Node* node2 ) {
+				return node1->data->coordinates[dim] < node2->data->coordinates[dim];
+			}
+		);
+	}
+
+	/// Depth first search that always takes the side of the split containing the point first,
+	/// and only crosses the split when the axis term alone is within the collector's bound. A
+	/// subtree whose tight box is out of the bound is skipped too, which the split planes alone
+	/// miss when the points don't fill their cell. Periodic metrics track the cell of each
+	/// subtree instead, since their split planes and boxes wrap.
+	template <
+		std::size_t Dimensions,
+		bool BoxPruning = true,
+		typename Metric,
+		typename Collector,
+		typename Point>
+	void search(
+		const Node* node,
+		const std::size_t depth,
+		const Point& point,
+		const Metric& metric,
+		Collector& collector,
+		Cell& cell
+	) const {
+		if ( node == nullptr ) {
+			return;
+		}
+		if constexpr ( is_tally<Collector> ) {
+			collector.visit( depth );
+		}
+		if constexpr ( BoxPruning && !kd_tree_metrics::IsPeriodic<Metric> ) {
+			if ( box_distance<Dimensions>( metric, subtree_lower( node ), subtree_upper( node ), point, point ) >
+				 collector.bound() ) {
+				if constexpr ( is_tally<Collector> ) {
+					collector.prune();
+				}
+				return;
+			}
+		}
+
+		collector.add(
+			metric.template reduced_distance<Dimensions, DistanceType>(
+				node->data->coordinates, point, dimensions
+			),
+			node
+		);
+
+		const std::size_t dim = split_dimension<Dimensions>( node, depth );
+		const DistanceType split = static_cast<DistanceType>( node->data->coordinates[dim] );
+		const DistanceType difference = static_cast<DistanceType>( point[dim] ) - split;
+		const Node* near = difference < DistanceType( 0 ) ? node->left : node->right;
+		const Node* far = difference < DistanceType( 0 ) ? node->right : node->left;
+
+		if constexpr ( kd_tree_metrics::IsPeriodic<Metric> ) {
+			DistanceType& near_limit =
+				difference < DistanceType( 0 ) ? cell.upper[dim] : cell.lower[dim];
+			DistanceType& far_limit =
+				difference < DistanceType( 0 ) ? cell.lower[dim] : cell.upper[dim];
+
+			const DistanceType near_previous = near_limit;
+			near_limit = split;
+			search<Dimensions, BoxPruning>( near, depth + 1, point, metric, collector, cell );
+			near_limit = near_previous;
+
+			const DistanceType far_previous = far_limit;
+			far_limit = split;
+			if ( metric.axis_to_interval(
+					 dim, static_cast<DistanceType>( point[dim] ), cell.lower[dim], cell.upper[dim]
+				 ) <= collector.bound() ) {
+				search<Dimensions, BoxPruning>( far, depth + 1, point, metric, collector, cell );
+			} else if constexpr ( is_tally<Collector> ) {
+				collector.prune( far );
+			}
+			far_limit = far_previous;
+		} else {
+			search<Dimensions, BoxPruning>( near, depth + 1, point, metric, collector, cell );
+			if ( metric.axis( dim, difference ) <= collector.bound() ) {
+				search<Dimensions, BoxPruning>( far, depth + 1, point, metric, collector, cell );
+			} else if constexpr ( is_tally<Collector> ) {
+				collector.prune( far );
+			}
+		}
+	}
+
+	/// Passes everything on to a collector while counting the search into QueryStats. Only
+	/// queries of a tree with an enabled Stats wrap their collector in one, so the checks for it
+	/// in the searches compile away otherwise.
+	template <typename Collector> struct TallyCollector {
+		Collector& collector;
+		kd_tree_stats::QueryStats counts;
+
+		DistanceType bound() const { return collector.bound(); }
+
+		void visit( const std::size_t depth ) {
+			counts.nodes_visited++;
+			counts.max_depth = std::max( counts.max_depth, depth + 1 );
+		}
+
+		void prune() { counts.pruned_subtrees++; }
+
+		void prune( const Node* subtree ) {
+			if ( subtree != nullptr ) {
+				counts.pruned_subtrees++;
+			}
+		}
+
+		void add( const DistanceType reduced, const Node* node ) {
+			measure( node );
+			collector.add( reduced, node );
+		}
+
+		void add( const DistanceType lower_reduced, const DistanceType upper_reduced, const Node* node ) {
+			measure( node );
+			collector.add( lower_reduced, upper_reduced, node );
+		}
+
+		void measure( const Node* node ) {
+			counts.distance_evaluations++;
+			if ( node->left == nullptr && node->right == nullptr ) {
+				counts.leaves_scanned++;
+			}
+		}
+	};
+
+	template <typename Collector>
+	static constexpr bool is_tally =
+		requires( Collector& collector ) { collector.visit( std::size_t( 0 ) ); };
+
+	/// Runs search( root, ... ) or quantized_search( root, ... ) as quantized is false or true,
+	/// returning its QueryStats if Stats is enabled and nothing counted otherwise
+	template <
+		std::size_t Dimensions,
+		bool Quantized = false,
+		typename Metric,
+		typename Collector,
+		typename Point>
+	kd_tree_stats::QueryStats search_root(
+		const Point& point, const Metric& metric, Collector& collector, Cell& cell
+	) const {
+		auto run = [&]( auto& any_collector ) {
+			if constexpr ( Quantized ) {
+				quantized_search<Dimensions>( root, 0, point, metric, any_collector );
+			} else {
+				search<Dimensions>( root, 0, point, metric, any_collector, cell );
+			}
+		};
+		if constexpr ( Stats::enabled ) {
+			TallyCollector<Collector> tally = { collector, {} };
+			run( tally );
+			return tally.counts;
+		} else {
+			run( collector );
+			return {};
+		}
+	}
+
+	/// Hands a finished query's counts to Stats, a no-op unless it's enabled
+	void record( const kd_tree_stats::QueryStats& counts ) const {
+		if constexpr ( Stats::enabled ) {
+			stats.record( counts );
+		}
+	}
+
+	static inline void prefetch( [[maybe_unused]] const void* address ) {
+#if defined( __GNUC__ ) || defined( __clang__ )
+		__builtin_prefetch( address );
+#endif
+	}
+
+	struct NoQueryStats {};
+
+	/// One query of nearest_neighbors_batch in flight. pending is search's recursion as a stack,
+	/// each node with the lower bound its split plane put on it, the far side of a split going
+	/// under the near side so it's only checked once the near side is done.
+	struct BatchLane {
+		struct Pending {
+			const Node* node;
+			std::size_t depth;
+			DistanceType reduced;
+		};
+
+		static constexpr std::size_t idle = std::numeric_limits<std::size_t>::max();
+
+		std::size_t query = idle;
+		KNearestCollector collector = { 0, {} };
+		std::vector<Pending> pending;
+		/// Whether the point of the node on top of pending has been prefetched
+		bool fetched = false;
+		[[no_unique_address]] std::conditional_t<Stats::enabled, kd_tree_stats::QueryStats, NoQueryStats>
+			counts;
+	};
+
+	/// Queues node on lane and prefetches it and its box, which the lane reads when it gets there
+	void push_pending(
+		BatchLane& lane, const Node* node, const std::size_t depth, const DistanceType reduced
+	) const {
+		lane.pending.push_back( { node, depth, reduced } );
+		prefetch( node );
+		prefetch( subtree_lower( node ) );
+	}
+
+	void start_lane( BatchLane& lane, const std::size_t query, const std::size_t k ) const {
+		lane.query = query;
+		lane.collector.k = k;
+		lane.collector.heap.clear();
+		lane.collector.heap.reserve( k );
+		lane.pending.clear();
+		lane.fetched = false;
+		lane.counts = {};
+		if ( root != nullptr ) {
+			push_pending( lane, root, 0, DistanceType( 0 ) );
+		}
+	}
+
+	/// Advances lane by one stage of search: prefetching the point of the next node to visit, or
+	/// visiting that node after the other lanes have had a turn for the prefetch to land. Returns
+	/// false once the query is done.
+	template <std::size_t Dimensions, typename Metric, typename Point>
+	bool step_lane( BatchLane& lane, const Point& point, const Metric& metric ) const {
+		std::vector<typename BatchLane::Pending>& pending = lane.pending;
+		while ( !pending.empty() && pending.back().reduced > lane.collector.bound() ) {
+			pending.pop_back();
+			if constexpr ( Stats::enabled ) {
+				lane.counts.pruned_subtrees++;
+			}
+		}
+		if ( pending.empty() ) {
+			return false;
+		}
+		if ( !lane.fetched ) {
+			prefetch( pending.back().node->data );
+			lane.fetched = true;
+			return true;
+		}
+		lane.fetched = false;
+		const Node* node = pending.back().node;
+		const std::size_t depth = pending.back().depth;
+		pending.pop_back();
+
+		if constexpr ( Stats::enabled ) {
+			lane.counts.nodes_visited++;
+			lane.counts.max_depth = std::max( lane.counts.max_depth, depth + 1 );
+		}
+		if ( box_distance<Dimensions>( metric, subtree_lower( node ), subtree_upper( node ), point, point ) >
+			 lane.collector.bound() ) {
+			if constexpr ( Stats::enabled ) {
+				lane.counts.pruned_subtrees++;
+			}
+			return true;
+		}
+		lane.collector.add(
+			metric.template reduced_distance<Dimensions, DistanceType>(
+				node->data->coordinates, point, dimensions
+			),
+			node
+		);
+		if constexpr ( Stats::enabled ) {
+			lane.counts.distance_evaluations++;
+			if ( node->left == nullptr && node->right == nullptr ) {
+				lane.counts.leaves_scanned++;
+			}
+		}
+
+		const std::size_t dim = split_dimension<Dimensions>( node, depth );
+		const DistanceType difference = static_cast<DistanceType>( point[dim] ) -
+			static_cast<DistanceType>( node->data->coordinates[dim] );
+		const Node* near = difference < DistanceType( 0 ) ? node->left : node->right;
+		const Node* far = difference < DistanceType( 0 ) ? node->right : node->left;
+		if ( far != nullptr ) {
+			push_pending( lane, far, depth + 1, metric.axis( dim, difference ) );
+		}
+		if ( near != nullptr ) {
+			push_pending( lane, near, depth + 1, DistanceType( 0 ) );
+		}
+		return true;
+	}
+
+	/// Passes everything on to Collector, counting the nodes the search visits
+	template <typename Collector> struct CountingCollector {
+		Collector collector;
+		std::size_t visited = 0;
+
+		DistanceType bound() const { return collector.bound(); }
+
+		void add( const DistanceType reduced, const Node* node ) {
+			visited++;
+			collector.add( reduced, node );
+		}
+	};
+
+	/// Upper bounds of the k best so far to prune with, and every point whose lower bound was
+	/// within them when it was found
+	struct QuantizedKNearestCollector {
+		KNearestCollector upper;
+		std::vector<Neighbor> candidates;
+
+		DistanceType bound() const { return upper.bound(); }
+
+		void add( const DistanceType lower_reduced, const DistanceType upper_reduced, const Node* node ) {
+			upper.add( upper_reduced, node );
+			if ( lower_reduced <= upper.bound() ) {
+				candidates.push_back( { lower_reduced, node->data } );
+			}
+		}
+	};
+
+	/// Points certainly inside the radius go straight to found, the ones the rounding can't
+	/// settle to candidates
+	struct QuantizedRadiusCollector {
+		DistanceType reduced_radius;
+		std::vector<DataType*> found;
+		std::vector<DataType*> candidates;
+
+		DistanceType bound() const { return reduced_radius; }
+
+		void add( const DistanceType lower_reduced, const DistanceType upper_reduced, const Node* node ) {
+			if ( upper_reduced <= reduced_radius ) {
+				found.push_back( node->data );
+			} else if ( lower_reduced <= reduced_radius ) {
+				candidates.push_back( node->data );
+			}
+		}
+	};
+
+	inline DistanceType dequantize( const std::size_t dim, const std::uint16_t quantized ) const {
+		return quantized_origin[dim] + ( quantized_step[dim] * static_cast<DistanceType>( quantized ) );
+	}
+
+	/// As search over the quantized copy, never reading the input. Each point's reduced distance
+	/// is bounded from below and above by the rounding of its coordinates, and the far side of a
+	/// split is pruned with the lower bound of its axis term.
+	template <std::size_t Dimensions, typename Metric, typename Collector, typename Point>
+	void quantized_search(
+		const Node* node,
+		const std::size_t depth,
+		const Point& point,
+		const Metric& metric,
+		Collector& collector
+	) const {
+		if ( node == nullptr ) {
+			return;
+		}
+		if constexpr ( is_tally<Collector> ) {
+			collector.visit( depth );
+		}
+		const std::uint16_t* quantized =
+			quantized_coordinates.data() + ( node_index( node ) * dimensions );
+		DistanceType lower = DistanceType( 0 );
+		DistanceType upper = DistanceType( 0 );
+		for ( std::size_t dim = 0; dim < dimension_count<Dimensions>(); dim++ ) {
+			const DistanceType difference =
+				std::abs( static_cast<DistanceType>( point[dim] ) - dequantize( dim, quantized[dim] ) );
+			lower = metric.combine(
+				lower,
+				metric.axis(
+					dim,
+					std::max(
+						( difference * ( 1 - quantized_relative_error ) ) - quantized_slack[dim],
+						DistanceType( 0 )
+					)
+				)
+			);
+			upper = metric.combine(
+				upper,
+				metric.axis( dim, ( difference * ( 1 + quantized_relative_error ) ) + quantized_slack[dim] )
+			);
+		}
+		collector.add( lower, upper, node );
+
+		const std::size_t dim = split_dimension<Dimensions>( node, depth );
+		const DistanceType difference =
+			static_cast<DistanceType>( point[dim] ) - dequantize( dim, quantized[dim] );
+		const Node* near = difference < DistanceType( 0 ) ? node->left : node->right;
+		const Node* far = difference < DistanceType( 0 ) ? node->right : node->left;
+		quantized_search<Dimensions>( near, depth + 1, point, metric, collector );
+		if ( metric.axis(
+				 dim,
+				 std::max(
+					 ( std::abs( difference ) * ( 1 - quantized_relative_error ) ) - quantized_slack[dim],
+					 DistanceType( 0 )
+				 )
+			 ) <= collector.bound() ) {
+			quantized_search<Dimensions>( far, depth + 1, point, metric, collector );
+		} else if constexpr ( is_tally<Collector> ) {
+			collector.prune( far );
+		}
+	}
+
+	/// nearest_neighbors on the quantized copy, reranking the candidates by their exact distance
+	template <typename Metric, typename Point>
+	std::vector<DataType*> quantized_nearest_neighbors(
+		const Point& point, const std::size_t k, const Metric& metric
+	) const {
+		QuantizedKNearestCollector collector = { { k, {} }, {} };
+		collector.upper.heap.reserve( k );
+		std::vector<Neighbor> exact;
+		kd_tree_stats::QueryStats counts;
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			Cell cell;
+			counts = search_root<Dimensions, true>( point, metric, collector, cell );
+			const DistanceType bound = collector.bound();
+			for ( const Neighbor& candidate : collector.candidates ) {
+				if ( candidate.reduced <= bound ) {
+					exact.push_back(
+						{ metric.template reduced_distance<Dimensions, DistanceType>(
+							  candidate.data->coordinates, point, dimensions
+						  ),
+						  candidate.data }
+					);
+				}
+			}
+		} );
+		counts.distance_evaluations += exact.size();
+		record( counts );
+		const std::size_t count = std::min( k, exact.size() );
+		std::partial_sort( exact.begin(), exact.begin() + static_cast<std::ptrdiff_t>( count ), exact.end() );
+		std::vector<DataType*> neighbors;
+		neighbors.reserve( count );
+		for ( std::size_t i = 0; i < count; i++ ) {
+			neighbors.push_back( exact[i].data );
+		}
+		return neighbors;
+	}
+
+	/// Lower bound on the reduced distance between any point of box a and any point of box b, a
+	/// point can be passed as both corners of its box.
+	template <
+		std::size_t Dimensions,
+		typename Metric,
+		typename LowerA,
+		typename UpperA,
+		typename LowerB,
+		typename UpperB>
+	DistanceType box_distance(
+		const Metric& metric,
+		const LowerA& lower_a,
+		const UpperA& upper_a,
+		const LowerB& lower_b,
+		const UpperB& upper_b
+	) const {
+		DistanceType reduced = DistanceType( 0 );
+		for ( std::size_t dim = 0; dim < dimension_count<Dimensions>(); dim++ ) {
+			const DistanceType gap = std::max(
+				{ static_cast<DistanceType>( lower_b[dim] ) - static_cast<DistanceType>( upper_a[dim] ),
+				  static_cast<DistanceType>( lower_a[dim] ) - static_cast<DistanceType>( upper_b[dim] ),
+				  DistanceType( 0 ) }
+			);
+			reduced = metric.combine( reduced, metric.axis( dim, gap ) );
+		}
+		return reduced;
+	}
+
+	void update_subtree_bound( const Node* node, NeighborGraph& graph ) const {
+		const std::size_t index = node_index( node );
+		DistanceType bound = graph.point_bound( index );
+		for ( const Node* child : { node->left, node->right } ) {
+			if ( child != nullptr ) {
+				bound = std::max( bound, graph.subtree_bound[node_index( child )] );
+			}
+		}
+		graph.subtree_bound[index] = bound;
+	}
+
+	/// One reference point against every point in query's subtree
+	template <std::size_t Dimensions, typename Metric>
+	void point_to_subtree(
+		const Node* query, DataType* reference, const Metric& metric, NeighborGraph& graph
+	) const {
+		const std::size_t index = node_index( query );
+		if ( box_distance<Dimensions>(
+				 metric,
+				 subtree_lower( query ),
+				 subtree_upper( query ),
+				 reference->coordinates,
+				 reference->coordinates
+			 ) > graph.subtree_bound[index] ) {
+			return;
+		}
+		if ( query->data != reference ) {
+			graph.add(
+				index,
+				metric.template reduced_distance<Dimensions, DistanceType>(
+					query->data->coordinates, reference->coordinates, dimensions
+				),
+				reference
+			);
+		}
+		for ( const Node* child : { query->left, query->right } ) {
+			if ( child != nullptr ) {
+				point_to_subtree<Dimensions>( child, reference, metric, graph );
+			}
+		}
+		update_subtree_bound( query, graph );
+	}
+
+	/// Every point in query's subtree against every point in reference's subtree. The pair is
+	/// dropped when their boxes are further apart than any query point's current k-th candidate,
+	/// otherwise each node's own point is handled directly and the children are paired up.
+	template <std::size_t Dimensions, typename Metric>
+	void dual_tree_neighbors(
+		const Node* query,
+		const Node* reference,
+		const std::size_t reference_depth,
+		const Metric& metric,
+		NeighborGraph& graph
+	) const {
+		const std::size_t index = node_index( query );
+		if ( box_distance<Dimensions>(
+				 metric,
+				 subtree_lower( query ),
+				 subtree_upper( query ),
+				 subtree_lower( reference ),
+				 subtree_upper( reference )
+			 ) > graph.subtree_bound[index] ) {
+			return;
+		}
+
+		GraphCollector collector = { &graph, index, query->data };
+		Cell cell;
+		search<Dimensions>(
+			reference, reference_depth, query->data->coordinates, metric, collector, cell
+		);
+
+		for ( const Node* query_child : { query->left, query->right } ) {
+			if ( query_child == nullptr ) {
+				continue;
+			}
+			point_to_subtree<Dimensions>( query_child, reference->data, metric, graph );
+
+			const Node* near = reference->left;
+			const Node* far = reference->right;
+			if ( near == nullptr || ( far != nullptr &&
+									  box_distance<Dimensions>(
+										  metric,
+										  subtree_lower( query_child ),
+										  subtree_upper( query_child ),
+										  subtree_lower( far ),
+										  subtree_upper( far )
+									  ) < box_distance<Dimensions>(
+											  metric,
+											  subtree_lower( query_child ),
+											  subtree_upper( query_child ),
+											  subtree_lower( near ),
+											  subtree_upper( near )
+										  ) ) ) {
+				std::swap( near, far );
+			}
+			for ( const Node* reference_child : { near, far } ) {
+				if ( reference_child != nullptr ) {
+					dual_tree_neighbors<Dimensions>(
+						query_child, reference_child, reference_depth + 1, metric, graph
+					);
+				}
+			}
+		}
+		update_subtree_bound( query, graph );
+	}
+
+	/// Upper bound on the reduced distance between any point of box a and any point of box b
+	template <std::size_t Dimensions, typename Metric, typename LowerA, typename UpperA, typename LowerB, typename UpperB>
+	DistanceType box_max_distance(
+		const Metric& metric,
+		const LowerA& lower_a,
+		const UpperA& upper_a,
+		const LowerB& lower_b,
+		const UpperB& upper_b
+	) const {
+		DistanceType reduced = DistanceType( 0 );
+		for ( std::size_t dim = 0; dim < dimension_count<Dimensions>(); dim++ ) {
+			const DistanceType span = std::max(
+				static_cast<DistanceType>( upper_b[dim] ) - static_cast<DistanceType>( lower_a[dim] ),
+				static_cast<DistanceType>( upper_a[dim] ) - static_cast<DistanceType>( lower_b[dim] )
+			);
+			reduced = metric.combine( reduced, metric.axis( dim, span ) );
+		}
+		return reduced;
+	}
+
+	static void count_depths(
+		const Node* node, const std::size_t depth, std::vector<std::size_t>& histogram
+	) {
+		if ( node == nullptr ) {
+			return;
+		}
+		if ( histogram.size() <= depth ) {
+			histogram.push_back( 0 );
+		}
+		histogram[depth]++;
+		count_depths( node->left, depth + 1, histogram );
+		count_depths( node->right, depth + 1, histogram );
+	}
+
+	template <typename Function> static void for_each_in_subtree( const Node* node, Function& function ) {
+		if ( node == nullptr ) {
+			return;
+		}
+		function( node );
+		for_each_in_subtree( node->left, function );
+		for_each_in_subtree( node->right, function );
+	}
+
+	/// Every pair of a point in a's subtree and a point in b's subtree within the radius, b may
+	/// belong to another tree. Pairs of nodes are skipped or emitted whole when their boxes are
+	/// entirely outside or inside the radius, otherwise each node's own point is searched in the
+	/// other subtree and the children are paired up.
+	template <std::size_t Dimensions, typename Metric, typename OtherTree, typename OtherNode, typename Callback>
+	void join_subtrees(
+		const Node* a,
+		const std::size_t a_depth,
+		const OtherTree& other,
+		const OtherNode* b,
+		const std::size_t b_depth,
+		const DistanceType reduced_radius,
+		const Metric& metric,
+		Callback& callback
+	) const {
+		const CoordinateType* a_lower = subtree_lower( a );
+		const CoordinateType* a_upper = subtree_upper( a );
+		const auto* b_lower = other.subtree_lower( b );
+		const auto* b_upper = other.subtree_upper( b );
+		if ( box_distance<Dimensions>( metric, a_lower, a_upper, b_lower, b_upper ) > reduced_radius ) {
+			return;
+		}
+		if ( box_max_distance<Dimensions>( metric, a_lower, a_upper, b_lower, b_upper ) <= reduced_radius ) {
+			auto emit_a = [&]( const Node* a_node ) {
+				auto emit_b = [&]( const OtherNode* b_node ) { callback( a_node->data, b_node->data ); };
+				OtherTree::for_each_in_subtree( b, emit_b );
+			};
+			for_each_in_subtree( a, emit_a );
+			return;
+		}
+
+		auto emit_with_a = [&]( const OtherNode* b_node ) { callback( a->data, b_node->data ); };
+		EmitCollector<decltype( emit_with_a )> a_collector = { reduced_radius, emit_with_a };
+		typename OtherTree::Cell b_cell;
+		other.template search<Dimensions>( b, b_depth, a->data->coordinates, metric, a_collector, b_cell );
+
+		for ( const Node* a_child : { a->left, a->right } ) {
+			if ( a_child == nullptr ) {
+				continue;
+			}
+			auto emit_with_b = [&]( const Node* a_node ) { callback( a_node->data, b->data ); };
+			EmitCollector<decltype( emit_with_b )> b_collector = { reduced_radius, emit_with_b };
+			Cell a_cell;
+			search<Dimensions>( a_child, a_depth + 1, b->data->coordinates, metric, b_collector, a_cell );
+			for ( const OtherNode* b_child : { b->left, b->right } ) {
+				if ( b_child != nullptr ) {
+					join_subtrees<Dimensions>(
+						a_child, a_depth + 1, other, b_child, b_depth + 1, reduced_radius, metric, callback
+					);
+				}
+			}
+		}
+	}
+
+	/// Every unordered pair of distinct points in node's subtree within the radius, once each
+	template <std::size_t Dimensions, typename Metric, typename Callback>
+	void self_join_subtree(
+		const Node* node,
+		const std::size_t depth,
+		const DistanceType reduced_radius,
+		const Metric& metric,
+		Callback& callback
+	) const {
+		if ( node == nullptr ) {
+			return;
+		}
+		const CoordinateType* lower = subtree_lower( node );
+		const CoordinateType* upper = subtree_upper( node );
+		if ( box_max_distance<Dimensions>( metric, lower, upper, lower, upper ) <= reduced_radius ) {
+			std::vector<const Node*> members;
+			auto collect = [&]( const Node* member ) { members.push_back( member ); };
+			for_each_in_subtree( node, collect );
+			for ( std::size_t i = 0; i < members.size(); i++ ) {
+				for ( std::size_t j = i + 1; j < members.size(); j++ ) {
+					callback( members[i]->data, members[j]->data );
+				}
+			}
+			return;
+		}
+
+		auto emit = [&]( const Node* other_node ) { callback( node->data, other_node->data ); };
+		EmitCollector<decltype( emit )> collector = { reduced_radius, emit };
+		for ( const Node* child : { node->left, node->right } ) {
+			Cell cell;
+			search<Dimensions>( child, depth + 1, node->data->coordinates, metric, collector, cell );
+			self_join_subtree<Dimensions>( child, depth + 1, reduced_radius, metric, callback );
+		}
+		if ( node->left != nullptr && node->right != nullptr ) {
+			join_subtrees<Dimensions>(
+				node->left, depth + 1, *this, node->right, depth + 1, reduced_radius, metric, callback
+			);
+		}
+	}
+
+	/// Walks the points inside [lower, upper], handing whole subtrees whose box is inside the query
+	/// to whole and the remaining matching points one at a time to single.
+	template <std::size_t Dimensions, typename Whole, typename Single>
+	void box_range(
+		const Node* node,
+		const CoordinatesType& lower,
+		const CoordinatesType& upper,
+		Whole& whole,
+		Single& single
+	) const {
+		if ( node == nullptr ) {
+			return;
+		}
+		const CoordinateType* node_lower = subtree_lower( node );
+		const CoordinateType* node_upper = subtree_upper( node );
+		bool inside = true;
+		bool point_inside = true;
+		for ( std::size_t dim = 0; dim < dimension_count<Dimensions>(); dim++ ) {
+			if ( node_upper[dim] < lower[dim] || upper[dim] < node_lower[dim] ) {
+				return;
+			}
+			inside = inside && lower[dim] <= node_lower[dim] && node_upper[dim] <= upper[dim];
+			point_inside = point_inside && lower[dim] <= node->data->coordinates[dim] &&
+				node->data->coordinates[dim] <= upper[dim];
+		}
+		if ( inside ) {
+			whole( node );
+			return;
+		}
+		if ( point_inside ) {
+			single( node );
+		}
+		box_range<Dimensions>( node->left, lower, upper, whole, single );
+		box_range<Dimensions>( node->right, lower, upper, whole, single );
+	}
+
+	/// As box_range for the points within a reduced radius of point
+	template <std::size_t Dimensions, typename Metric, typename Whole, typename Single>
+	void radius_range(
+		const Node* node,
+		const CoordinatesType& point,
+		const DistanceType reduced_radius,
+		const Metric& metric,
+		Whole& whole,
+		Single& single
+	) const {
+		if ( node == nullptr ) {
+			return;
+		}
+		const CoordinateType* node_lower = subtree_lower( node );
+		const CoordinateType* node_upper = subtree_upper( node );
+		if ( box_distance<Dimensions>( metric, node_lower, node_upper, point, point ) > reduced_radius ) {
+			return;
+		}
+		if ( box_max_distance<Dimensions>( metric, node_lower, node_upper, point, point ) <=
+			 reduced_radius ) {
+			whole( node );
+			return;
+		}
+		if ( metric.template reduced_distance<Dimensions, DistanceType>(
+				 node->data->coordinates, point, dimensions
+			 ) <= reduced_radius ) {
+			single( node );
+		}
+		radius_range<Dimensions>( node->left, point, reduced_radius, metric, whole, single );
+		radius_range<Dimensions>( node->right, point, reduced_radius, metric, whole, single );
+	}
+
+	/// A bandwidth of 0 or less would divide every distance into inf or NaN, and a negative
+	/// relative_error would never accept an estimate. NaN fails both.
+	static void check_kernel_arguments(
+		const DistanceType bandwidth, const DistanceType relative_error
+	) {
+		if ( !( bandwidth > DistanceType( 0 ) ) ) {
+			throw std::invalid_argument( "kernel_density needs a positive bandwidth" );
+		}
+		if ( !( relative_error >= DistanceType( 0 ) ) ) {
+			throw std::invalid_argument( "kernel_density needs a relative_error of at least 0" );
+		}
+	}
+
+	/// Adds node's subtree to a kernel sum. lower is a running lower bound on the full sum, which
+	/// already holds count * kernel( furthest corner ) for node, and estimate the running sum
+	/// itself. A subtree adds the midpoint of its kernel range to estimate when half that range
+	/// per point is within the error budget of lower, so the approximated subtrees together stay
+	/// within relative_error of the sum. Its share of lower stays at that furthest corner.
+	template <std::size_t Dimensions, typename Kernel, typename Metric>
+	void kernel_sum(
+		const Node* node,
+		const CoordinatesType& point,
+		const DistanceType bandwidth,
+		const DistanceType relative_error,
+		const Kernel& kernel,
+		const Metric& metric,
+		DistanceType& lower,
+		DistanceType& estimate
+	) const {
+		const CoordinateType* node_lower = subtree_lower( node );
+		const CoordinateType* node_upper = subtree_upper( node );
+		const DistanceType count = static_cast<DistanceType>( node->subtree_size );
+		const DistanceType kernel_max = kernel(
+			metric.to_distance( box_distance<Dimensions>( metric, node_lower, node_upper, point, point ) ) /
+			bandwidth
+		);
+		const DistanceType kernel_min = kernel(
+			metric.to_distance(
+				box_max_distance<Dimensions>( metric, node_lower, node_upper, point, point )
+			) /
+			bandwidth
+		);
+		if ( kernel_max - kernel_min <= DistanceType( 2 ) * relative_error * lower /
+				 static_cast<DistanceType>( nodes.size() ) ) {
+			estimate += count * ( kernel_max + kernel_min ) / DistanceType( 2 );
+			return;
+		}
+
+		lower -= count * kernel_min;
+		const DistanceType own = kernel(
+			metric.to_distance( metric.template reduced_distance<Dimensions, DistanceType>(
+				node->data->coordinates, point, dimensions
+			) ) /
+			bandwidth
+		);
+		estimate += own;
+		lower += own;
+
+		const Node* near = node->left;
+		const Node* far = node->right;
+		if ( near == nullptr ||
+			 ( far != nullptr &&
+			   box_distance<Dimensions>( metric, subtree_lower( far ), subtree_upper( far ), point, point ) <
+				   box_distance<Dimensions>(
+					   metric, subtree_lower( near ), subtree_upper( near ), point, point
+				   ) ) ) {
+			std::swap( near, far );
+		}
+		for ( const Node* child : { near, far } ) {
+			if ( child != nullptr ) {
+				lower += static_cast<DistanceType>( child->subtree_size ) *
+					kernel(
+						metric.to_distance( box_max_distance<Dimensions>(
+							metric, subtree_lower( child ), subtree_upper( child ), point, point
+						) ) /
+						bandwidth
+					);
+			}
+		}
+		for ( const Node* child : { near, far } ) {
+			if ( child != nullptr ) {
+				kernel_sum<Dimensions>(
+					child, point, bandwidth, relative_error, kernel, metric, lower, estimate
+				);
+			}
+		}
+	}
+
+	/// Splits the tree at split_depth into subtrees that can be searched independently, the
+	/// nodes above them are searched one point at a time.
+	void collect_query_subtrees(
+		const Node* node,
+		const std::size_t depth,
+		const std::size_t split_depth,
+		std::vector<const Node*>& subtrees,
+		std::vector<const Node*>& above
+	) const {
+		if ( node == nullptr ) {
+			return;
+		}
+		if ( depth == split_depth ) {
+			subtrees.push_back( node );
+			return;
+		}
+		above.push_back( node );
+		collect_query_subtrees( node->left, depth + 1, split_depth, subtrees, above );
+		collect_query_subtrees( node->right, depth + 1, split_depth, subtrees, above );
+	}
+
+	/// The starting cell for a search, only periodic metrics need one. Periodic axes span the
+	/// box and open axes are unbounded.
+	template <typename Metric> Cell root_cell( const Metric& metric ) const {
+		Cell cell;
+		if constexpr ( kd_tree_metrics::IsPeriodic<Metric> ) {
+			if constexpr ( static_dimensions == 0 ) {
+				cell.lower.resize( dimensions );
+				cell.upper.resize( dimensions );
+			}
+			for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+				const DistanceType period = metric.template period<DistanceType>( dim );
+				cell.lower[dim] = period > DistanceType( 0 ) ? DistanceType( 0 )
+															 : std::numeric_limits<DistanceType>::lowest();
+				cell.upper[dim] = period > DistanceType( 0 ) ? period
+															 : std::numeric_limits<DistanceType>::max();
+			}
+		}
+		return cell;
+	}
+
+	public:
+	/// Read only view of a node and everything below it, for algorithms outside the tree that
+	/// prune with its box, size and aggregate. index() is unique in [0, size()) for keeping state
+	/// per subtree. A view past a leaf is empty and converts to false.
+	class Subtree {
+		friend class KD_Tree;
+
+		const KD_Tree* tree = nullptr;
+		const Node* node = nullptr;
+
+		Subtree( const KD_Tree* owner, const Node* subtree_root ) : tree( owner ), node( subtree_root ) {}
+
+		public:
+		Subtree() = default;
+
+		explicit operator bool() const { return node != nullptr; }
+
+		/// The point stored at this node, not every point in the subtree
+		const DataType& point() const { return *node->data; }
+
+		std::size_t size() const { return node->subtree_size; }
+
+		std::size_t index() const { return tree->node_index( node ); }
+
+		const CoordinateType* lower() const { return tree->subtree_lower( node ); }
+
+		const CoordinateType* upper() const { return tree->subtree_upper( node ); }
+
+		Subtree left() const { return { tree, node->left }; }
+
+		Subtree right() const { return { tree, node->right }; }
+
+		const AggregateValue& aggregate() const
+			requires has_aggregate
+		{
+			return tree->subtree_aggregates[tree->node_index( node )];
+		}
+	};
+
+	/// Only pass a pointer to the KD Tree if you're sure that input_data will be preserved
+	/// in scope for the lifetime of the KD Tree.
+	explicit KD_Tree( std::shared_ptr<Input> data ) noexcept : input_data( std::move( data ) ) {
+		generate_tree( input_data.get() );
+	}
+
+	/// Passing by value leads to the value being moved into the tree, which then owns it. This
+	/// should only be done to preserve the input_data if it would otherwise go out of scope, or
+	/// to let reorder_input rearrange it. Only inputs that keep their elements on the heap, such
+	/// as std::vector, can be owned, so that moving the tree leaves its nodes pointing at them.
+	explicit KD_Tree( Input&& data ) noexcept
+		requires kd_tree_types::IsOwnableInput<Input>
+		: input_data( std::move( data ) ) {
+		generate_tree( &input_data );
+	}
+
+	/// As above, also keeping aggregate for every subtree for aggregate_in_box and
+	/// aggregate_within_radius.
+	KD_Tree( std::shared_ptr<Input> data, Aggregate tree_aggregate ) noexcept
+		: input_data( std::move( data ) ), aggregate( std::move( tree_aggregate ) ) {
+		generate_tree( input_data.get() );
+	}
+
+	KD_Tree( Input&& data, Aggregate tree_aggregate ) noexcept
+		requires kd_tree_types::IsOwnableInput<Input>
+		: input_data( std::move( data ) ), aggregate( std::move( tree_aggregate ) ) {
+		generate_tree( &input_data );
+	}
+
+	/// As above, choosing each node's split with tree_split_rule from kd_tree_splits. Pass
+	/// kd_tree_aggregates::None() to keep no aggregate.
+	KD_Tree( std::shared_ptr<Input> data, Aggregate tree_aggregate, SplitRule tree_split_rule ) noexcept
+		: input_data( std::move( data ) ),
+		  aggregate( std::move( tree_aggregate ) ),
+		  split_rule( std::move( tree_split_rule ) ) {
+		generate_tree( input_data.get() );
+	}
+
+	KD_Tree( Input&& data, Aggregate tree_aggregate, SplitRule tree_split_rule ) noexcept
+		requires kd_tree_types::IsOwnableInput<Input>
+		: input_data( std::move( data ) ),
+		  aggregate( std::move( tree_aggregate ) ),
+		  split_rule( std::move( tree_split_rule ) ) {
+		generate_tree( &input_data );
+	}
+
+	/// As above, handing the QueryStats of each nearest_neighbor, nearest_neighbors,
+	/// nearest_neighbors_batch and within_radius query to tree_stats, such as a
+	/// kd_tree_stats::Counting
+	KD_Tree(
+		std::shared_ptr<Input> data,
+		Aggregate tree_aggregate,
+		SplitRule tree_split_rule,
+		Stats tree_stats
+	) noexcept
+		: input_data( std::move( data ) ),
+		  aggregate( std::move( tree_aggregate ) ),
+		  split_rule( std::move( tree_split_rule ) ),
+		  stats( std::move( tree_stats ) ) {
+		generate_tree( input_data.get() );
+	}
+
+	KD_Tree(
+		Input&& data, Aggregate tree_aggregate, SplitRule tree_split_rule, Stats tree_stats
+	) noexcept
+		requires kd_tree_types::IsOwnableInput<Input>
+		: input_data( std::move( data ) ),
+		  aggregate( std::move( tree_aggregate ) ),
+		  split_rule( std::move( tree_split_rule ) ),
+		  stats( std::move( tree_stats ) ) {
+		generate_tree( &input_data );
+	}
+
+	/// Adds the points of data_container, if any, and rebuilds the tree. Throws
+	/// std::invalid_argument for points without coordinates, which have no axis to split on.
+	void generate_tree( Input* data_container = nullptr ) {
+		if constexpr ( !kd_tree_types::InputContainsStaticCoordinates<Input> ) {
+			if ( data_container != nullptr && !data_container->empty() &&
+				 ( *data_container )[0].coordinates.size() == 0 ) {
+				throw std::invalid_argument( "KD_Tree needs points with at least one coordinate" );
+			}
+		}
+		using Clock = std::chrono::steady_clock;
+		const Clock::time_point start = Clock::now();
+		Clock::time_point phase_start = start;
+		// the time since the previous phase ended
+		auto phase_time = [&phase_start] {
+			const Clock::time_point now = Clock::now();
+			const auto elapsed =
+				std::chrono::duration_cast<std::chrono::nanoseconds>( now - phase_start );
+			phase_start = now;
+			return elapsed;
+		};
+		build_phases = {};
+
+		if constexpr ( kd_tree_types::InputContainsStaticCoordinates<Input> ) {
+			dimensions = kd_tree_types::staticDimensions<Input>;
+		} else if ( data_container != nullptr && !data_container->empty() ) {
+			dimensions = ( *data_container )[0].coordinates.size();
+		}
+		std::size_t total_size = nodes.size();
+		if ( data_container != nullptr ) {
+			if constexpr ( std::is_array_v<Input> ) {
+				total_size += std::extent_v<Input>;
+			} else {
+				total_size += data_container->size();
+			}
+		}
+
+		// reserve the space for all the data in the presorted dimensions, rebuilding from scratch
+		// if this tree was already generated
+		nodes.reserve( total_size );
+		if constexpr ( !kd_tree_types::InputContainsStaticCoordinates<Input> ) {
+			presorted_dimensions.resize( dimensions );
+		}
+		for ( std::vector<Node*>& presorted_dim : presorted_dimensions ) {
+			presorted_dim.clear();
+			presorted_dim.reserve( total_size );
+		}
+
+		// add existing nodes to the presorted vectors
+		for ( Node& node : nodes ) {
+			for ( std::vector<Node*>& presorted_dim : presorted_dimensions ) {
+				presorted_dim.emplace_back( &node );
+			}
+		}
+
+		// add the new nodes in the data vector to both nodes and presorteds
+		if ( data_container != nullptr ) {
+			for ( DataType& data : *data_container ) {
+				nodes.emplace_back( nullptr, nullptr, &data, 0 );
+				for ( std::vector<Node*>& presorted_dim : presorted_dimensions ) {
+					presorted_dim.emplace_back( &nodes.back() );
+				}
+			}
+		}
+
+		build_phases.node_creation = phase_time();
+
+		// actually sort the presorted dimensions
+		for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+			presort_dimension( dim );
+			build_phases.presort.push_back( phase_time() );
+		}
+
+		// the root's cell is the bounding box of all the points
+		Cell cell;
+		if constexpr ( !kd_tree_types::InputContainsStaticCoordinates<Input> ) {
+			cell.lower.resize( dimensions );
+			cell.upper.resize( dimensions );
+		}
+		for ( std::size_t dim = 0; dim < dimensions && total_size != 0; dim++ ) {
+			cell.lower[dim] =
+				static_cast<DistanceType>( presorted_dimensions[dim].front()->data->coordinates[dim] );
+			cell.upper[dim] =
+				static_cast<DistanceType>( presorted_dimensions[dim].back()->data->coordinates[dim] );
+		}
+
+		partition_scratch.resize( total_size );
+		partition_goes_left.resize( total_size );
+		link_tree( 0, total_size, 0, root, cell );
+		partition_scratch = std::vector<Node*>();
+		partition_goes_left = std::vector<std::uint8_t>();
+		build_phases.link = phase_time();
+
+		quantized_coordinates.clear();
+		subtree_bounds.resize( total_size * 2 * dimensions );
+		if constexpr ( has_aggregate ) {
+			subtree_aggregates.resize( total_size );
+		}
+		if ( root != nullptr ) {
+			summarize_tree( root );
+		}
+		build_phases.summarize = phase_time();
+		build_phases.total =
+			std::chrono::duration_cast<std::chrono::nanoseconds>( phase_start - start );
+	}
+
+	/// How the last generate_tree spent its time, the memory the tree holds now and the tree's
+	/// shape, for sizing machines and for telling whether a build is bound by sorting or linking.
+	/// The input itself isn't counted, whether or not the tree owns it.
+	kd_tree_types::BuildReport build_report() const {
+		kd_tree_types::BuildReport report;
+		report.phases = build_phases;
+
+		kd_tree_types::BuildReport::Memory& memory = report.memory;
+		memory.nodes = nodes.capacity() * sizeof( Node );
+		for ( const std::vector<Node*>& presorted_dim : presorted_dimensions ) {
+			memory.presorted += presorted_dim.capacity() * sizeof( Node* );
+		}
+		memory.subtree_bounds = subtree_bounds.capacity() * sizeof( CoordinateType );
+		memory.subtree_aggregates = subtree_aggregates.capacity() * sizeof( AggregateValue );
+		memory.quantized = quantized_coordinates.capacity() * sizeof( std::uint16_t );
+		memory.link_scratch = nodes.size() * ( sizeof( Node* ) + sizeof( std::uint8_t ) );
+
+		kd_tree_types::BuildReport::Shape& shape = report.shape;
+		count_depths( root, 0, shape.depth_histogram );
+		shape.height = shape.depth_histogram.size();
+		if ( !nodes.empty() ) {
+			std::size_t depth_sum = 0;
+			for ( std::size_t depth = 0; depth < shape.height; depth++ ) {
+				depth_sum += depth * shape.depth_histogram[depth];
+			}
+			shape.mean_depth = static_cast<double>( depth_sum ) / static_cast<double>( nodes.size() );
+			shape.imbalance = static_cast<double>( shape.height ) /
+				static_cast<double>( std::bit_width( nodes.size() ) );
+		}
+		return report;
+	}
+
+	/// Keeps a 16 bit copy of every coordinate, spread evenly over the tree's bounding box.
+	/// nearest_neighbor, nearest_neighbors, nearest_neighbors_batch and within_radius then walk
+	/// the copy instead of the input, a quarter of the bytes for double coordinates, and only read
+	/// the original coordinates to rerank the points the rounding leaves in doubt. Results are
+	/// unchanged.
+	/// Periodic metrics keep using the original coordinates, and generate_tree drops the copy.
+	void quantize() {
+		constexpr DistanceType levels = DistanceType( std::numeric_limits<std::uint16_t>::max() );
+		quantized_coordinates.assign( nodes.size() * dimensions, 0 );
+		if constexpr ( !kd_tree_types::InputContainsStaticCoordinates<Input> ) {
+			quantized_origin.resize( dimensions );
+			quantized_step.resize( dimensions );
+			quantized_slack.resize( dimensions );
+		}
+		if ( root == nullptr ) {
+			return;
+		}
+		for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+			quantized_origin[dim] = static_cast<DistanceType>( subtree_lower( root )[dim] );
+			const DistanceType extent =
+				static_cast<DistanceType>( subtree_upper( root )[dim] ) - quantized_origin[dim];
+			quantized_step[dim] = extent / levels;
+			quantized_slack[dim] = ( quantized_step[dim] / 2 ) +
+				( quantized_relative_error * ( std::abs( quantized_origin[dim] ) + extent ) );
+		}
+		std::for_each( std::execution::par, nodes.begin(), nodes.end(), [&]( const Node& node ) {
+			std::uint16_t* quantized = quantized_coordinates.data() + ( node_index( &node ) * dimensions );
+			for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+				const DistanceType offset =
+					static_cast<DistanceType>( node.data->coordinates[dim] ) - quantized_origin[dim];
+				quantized[dim] = quantized_step[dim] > DistanceType( 0 )
+					? static_cast<std::uint16_t>(
+						  std::clamp( std::round( offset / quantized_step[dim] ), DistanceType( 0 ), levels )
+					  )
+					: std::uint16_t( 0 );
+			}
+		} );
+	}
+
+	/// The Z order code of point within the box around the tree, clamped to it, for sorting
+	/// points or queries so that neighbors in the order are mostly neighbors in space. Every
+	/// point has code 0 in an empty tree, which has no dimensions to spread the bits over.
+	template <typename Point> std::uint64_t morton_code( const Point& point ) const {
+		if ( root == nullptr || dimensions == 0 ) {
+			return 0;
+		}
+		// as many bits per axis as fit in 64, at least one for each of the first 64 axes, and no
+		// more than 63 so the shift stays within the word for a single axis
+		const std::size_t bits = std::clamp<std::size_t>( 64 / dimensions, 1, 63 );
+		const std::uint64_t last_cell = ( std::uint64_t( 1 ) << bits ) - 1;
+		const auto cells = static_cast<DistanceType>( last_cell );
+		std::uint64_t code = 0;
+		for ( std::size_t dim = 0; dim < std::min<std::size_t>( dimensions, 64 ); dim++ ) {
+			const auto lower = static_cast<DistanceType>( subtree_lower( root )[dim] );
+			const auto extent = static_cast<DistanceType>( subtree_upper( root )[dim] ) - lower;
+			// cells rounds up when DistanceType can't hold it exactly, the upper edge included
+			const std::uint64_t cell = std::min(
+				static_cast<std::uint64_t>(
+					extent > DistanceType( 0 )
+						? std::clamp(
+							  ( static_cast<DistanceType>( point[dim] ) - lower ) / extent,
+							  DistanceType( 0 ),
+							  DistanceType( 1 )
+						  ) * cells
+						: DistanceType( 0 )
+				),
+				last_cell
+			);
+			for ( std::size_t bit = 0; bit < bits && ( bit * dimensions ) + dim < 64; bit++ ) {
+				code |= ( ( cell >> bit ) & 1U ) << ( ( bit * dimensions ) + dim );
+			}
+		}
+		return code;
+	}
+
+	/// Moves the records of an owned input, one moved into the tree, into order and relinks the
+	/// tree to them, so that walking the tree reads the input sequentially. In tree order node
+	/// i's data is then element i of the input, the same record for every node index. Morton
+	/// order sorts by Z order and rebuilds, dropping any quantized copy. Throws std::logic_error
+	/// if generate_tree was since given more points, which don't live in the input.
+	void reorder_input( const kd_tree_types::InputOrder order = kd_tree_types::InputOrder::tree )
+		requires std::same_as<WrappedInput, Input>
+	{
+		if ( root == nullptr ) {
+			return;
+		}
+		const std::size_t count = nodes.size();
+		if ( count != std::size( input_data ) ) {
+			throw std::logic_error( "reorder_input needs every point of the tree in its input" );
+		}
+		DataType* const first = &*std::begin( input_data );
+		auto move_records = [&]( const auto& source_of ) {
+			std::vector<DataType> reordered;
+			reordered.reserve( count );
+			for ( std::size_t i = 0; i < count; i++ ) {
+				reordered.push_back( std::move( *source_of( i ) ) );
+			}
+			std::move( reordered.begin(), reordered.end(), first );
+		};
+
+		if ( order == kd_tree_types::InputOrder::morton ) {
+			std::vector<std::pair<std::uint64_t, DataType*>> codes( count );
+			std::for_each( std::execution::par, nodes.begin(), nodes.end(), [&]( const Node& node ) {
+				codes[node_index( &node )] = { morton_code( node.data->coordinates ), node.data };
+			} );
+			std::sort( std::execution::par_unseq, codes.begin(), codes.end(), []( const auto& a, const auto& b ) {
+				return a.first < b.first;
+			} );
+			move_records( [&]( const std::size_t i ) { return codes[i].second; } );
+			nodes.clear();
+			root = nullptr;
+			generate_tree( &input_data );
+			return;
+		}
+
+		std::vector<Node*> preorder;
+		preorder.reserve( count );
+		std::vector<Node*> stack = { root };
+		while ( !stack.empty() ) {
+			Node* node = stack.back();
+			stack.pop_back();
+			preorder.push_back( node );
+			for ( Node* child : { node->right, node->left } ) {
+				if ( child != nullptr ) {
+					stack.push_back( child );
+				}
+			}
+		}
+		std::vector<std::size_t> new_index( count );
+		for ( std::size_t i = 0; i < count; i++ ) {
+			new_index[node_index( preorder[i] )] = i;
+		}
+		move_records( [&]( const std::size_t i ) { return preorder[i]->data; } );
+
+		std::vector<Node> reordered( count );
+		auto relink = [&]( Node* node ) {
+			return node == nullptr ? nullptr : &reordered[new_index[node_index( node )]];
+		};
+		for ( std::size_t i = 0; i < count; i++ ) {
+			reordered[i] = *preorder[i];
+			reordered[i].left = relink( preorder[i]->left );
+			reordered[i].right = relink( preorder[i]->right );
+			reordered[i].data = first + i;
+		}
+		for ( std::vector<Node*>& presorted_dim : presorted_dimensions ) {
+			for ( Node*& node : presorted_dim ) {
+				node = relink( node );
+			}
+		}
+		auto permute = [&]( auto& values, const std::size_t stride ) {
+			if ( values.empty() ) {
+				return;
+			}
+			std::remove_reference_t<decltype( values )> permuted( values.size() );
+			for ( std::size_t i = 0; i < count; i++ ) {
+				std::copy_n(
+					values.begin() + static_cast<std::ptrdiff_t>( i * stride ),
+					stride,
+					permuted.begin() + static_cast<std::ptrdiff_t>( new_index[i] * stride )
+				);
+			}
+			values = std::move( permuted );
+		};
+		permute( subtree_bounds, 2 * dimensions );
+		permute( subtree_aggregates, 1 );
+		permute( quantized_coordinates, dimensions );
+		nodes = std::move( reordered );
+		root = nodes.data();
+	}
+
+	/// The whole tree, empty if there are no points
+	Subtree root_subtree() const { return { this, root }; }
+
+	std::size_t size() const { return nodes.size(); }
+
+	std::size_t get_dimensions() const { return dimensions; }
+
+	/// Deep enough that the subtrees below it keep every hardware thread busy, for splitting
+	/// work over root_subtree() between threads
+	static std::size_t parallel_split_depth() {
+		const std::size_t subtree_target =
+			8 * std::max<std::size_t>( 1, std::thread::hardware_concurrency() );
+		std::size_t split_depth = 0;
+		while ( ( std::size_t( 1 ) << split_depth ) < subtree_target ) {
+			split_depth++;
+		}
+		return split_depth;
+	}
+
+	/// The policy the tree's queries report their QueryStats to
+	const Stats& query_stats() const { return stats; }
+
+	/// The closest point to point under metric, or nullptr if the tree is empty. Any of the
+	/// queries can be given a kd_tree_metrics::Periodic metric for minimum image results.
+	template <typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType>
+	DataType* nearest_neighbor( const CoordinatesType& point, const Metric& metric = Metric() ) const {
+		if constexpr ( !kd_tree_metrics::IsPeriodic<Metric> ) {
+			if ( !quantized_coordinates.empty() ) {
+				const std::vector<DataType*> nearest = quantized_nearest_neighbors( point, 1, metric );
+				return nearest.empty() ? nullptr : nearest.front();
+			}
+		}
+		NearestCollector collector;
+		Cell cell = root_cell( metric );
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			record( search_root<Dimensions>( point, metric, collector, cell ) );
+		} );
+		return collector.best.data;
+	}
+
+	/// The k closest points to point under metric, closest first.
+	template <typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType>
+	std::vector<DataType*> nearest_neighbors(
+		const CoordinatesType& point, const std::size_t k, const Metric& metric = Metric()
+	) const {
+		if constexpr ( !kd_tree_metrics::IsPeriodic<Metric> ) {
+			if ( !quantized_coordinates.empty() ) {
+				return quantized_nearest_neighbors( point, k, metric );
+			}
+		}
+		KNearestCollector collector = { k, {} };
+		collector.heap.reserve( k );
+		Cell cell = root_cell( metric );
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			record( search_root<Dimensions>( point, metric, collector, cell ) );
+		} );
+		std::sort_heap( collector.heap.begin(), collector.heap.end() );
+		std::vector<DataType*> neighbors;
+		neighbors.reserve( collector.heap.size() );
+		for ( const Neighbor& neighbor : collector.heap ) {
+			neighbors.push_back( neighbor.data );
+		}
+		return neighbors;
+	}
+
+	/// nearest_neighbors( queries[i], k, metric ) for every i, interleaving group queries at a
+	/// time. On a tree larger than the cache a lone descent is a chain of misses, each waiting on
+	/// the last. Here each query prefetches the next node or point it needs and hands over to the
+	/// next query before touching it, so the misses of the group overlap, and a query that
+	/// finishes hands its place to the next one waiting. queries is anything indexable whose
+	/// elements index like coordinates. On a quantized tree each query is answered on its own by
+	/// nearest_neighbors' quantized search instead, which already reads far less memory.
+	template <typename Queries, typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType> &&
+		( !kd_tree_metrics::IsPeriodic<Metric> )
+	std::vector<std::vector<DataType*>> nearest_neighbors_batch(
+		const Queries& queries,
+		const std::size_t k,
+		const Metric& metric = Metric(),
+		const std::size_t group = 8
+	) const {
+		const std::size_t count = std::size( queries );
+		std::vector<std::vector<DataType*>> results( count );
+		if ( !quantized_coordinates.empty() ) {
+			for ( std::size_t i = 0; i < count; i++ ) {
+				results[i] = quantized_nearest_neighbors( queries[i], k, metric );
+			}
+			return results;
+		}
+		std::vector<BatchLane> lanes( std::min( std::max<std::size_t>( group, 1 ), count ) );
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			std::size_t next = 0;
+			for ( BatchLane& lane : lanes ) {
+				start_lane( lane, next++, k );
+			}
+			std::size_t active = lanes.size();
+			while ( active != 0 ) {
+				for ( BatchLane& lane : lanes ) {
+					if ( lane.query == BatchLane::idle ||
+						 step_lane<Dimensions>( lane, queries[lane.query], metric ) ) {
+						continue;
+					}
+					std::vector<Neighbor>& heap = lane.collector.heap;
+					std::sort_heap( heap.begin(), heap.end() );
+					std::vector<DataType*>& neighbors = results[lane.query];
+					neighbors.reserve( heap.size() );
+					for ( const Neighbor& neighbor : heap ) {
+						neighbors.push_back( neighbor.data );
+					}
+					if constexpr ( Stats::enabled ) {
+						record( lane.counts );
+					}
+					if ( next < count ) {
+						start_lane( lane, next++, k );
+					} else {
+						lane.query = BatchLane::idle;
+						active--;
+					}
+				}
+			}
+		} );
+		return results;
+	}
+
+	/// Every point in increasing distance from a query point, found as the iterator is advanced.
+	/// This is the distance browsing of Hjaltason and Samet: subtrees wait in a priority queue
+	/// keyed on the distance to their box, and a point is only yielded once nothing left in the
+	/// queue can be closer, so stopping early skips the rest of the traversal. The range is
+	/// single pass and the tree has to outlive it.
+	template <typename Metric> class IncrementalNeighbors {
+		friend class KD_Tree;
+
+		/// C array coordinates are copied into a std::array
+		using QueryPoint = std::conditional_t<
+			std::is_array_v<CoordinatesType>,
+			std::array<CoordinateType, std::extent_v<CoordinatesType>>,
+			CoordinatesType>;
+
+		struct Entry {
+			DistanceType reduced;
+			const Node* node;
+			bool is_point;
+
+			bool operator>( const Entry& other ) const { return reduced > other.reduced; }
+		};
+
+		const KD_Tree* tree;
+		QueryPoint point;
+		Metric metric;
+		std::vector<Entry> queue;
+		Entry current = { DistanceType( 0 ), nullptr, true };
+		bool started = false;
+
+		IncrementalNeighbors( const KD_Tree* owner, const CoordinatesType& query, const Metric& query_metric )
+			: tree( owner ), metric( query_metric ) {
+			if constexpr ( std::is_array_v<CoordinatesType> ) {
+				std::copy( std::begin( query ), std::end( query ), point.begin() );
+			} else {
+				point = query;
+			}
+			if ( tree->root != nullptr ) {
+				push_subtree( tree->root );
+			}
+		}
+
+		void push( const Entry entry ) {
+			queue.push_back( entry );
+			std::push_heap( queue.begin(), queue.end(), std::greater<>() );
+		}
+
+		void push_subtree( const Node* node ) {
+			push(
+				{ tree->template box_distance<static_dimensions>(
+					  metric, tree->subtree_lower( node ), tree->subtree_upper( node ), point, point
+				  ),
+				  node,
+				  false }
+			);
+		}
+
+		/// Expands subtrees until the closest entry left is a point
+		void advance() {
+			while ( !queue.empty() ) {
+				std::pop_heap( queue.begin(), queue.end(), std::greater<>() );
+				const Entry entry = queue.back();
+				queue.pop_back();
+				if ( entry.is_point ) {
+					current = entry;
+					return;
+				}
+				push(
+					{ metric.template reduced_distance<static_dimensions, DistanceType>(
+						  entry.node->data->coordinates, point, tree->dimensions
+					  ),
+					  entry.node,
+					  true }
+				);
+				for ( const Node* child : { entry.node->left, entry.node->right } ) {
+					if ( child != nullptr ) {
+						push_subtree( child );
+					}
+				}
+			}
+			current.node = nullptr;
+		}
+
+		public:
+		class iterator {
+			IncrementalNeighbors* range = nullptr;
+
+			public:
+			using value_type = DataType*;
+			using difference_type = std::ptrdiff_t;
+
+			iterator() = default;
+
+			explicit iterator( IncrementalNeighbors* owner ) : range( owner ) {}
+
+			DataType* operator*() const { return range->current.node->data; }
+
+			/// How far the current point is from the query point
+			DistanceType distance() const { return range->metric.to_distance( range->current.reduced ); }
+
+			iterator& operator++() {
+				range->advance();
+				return *this;
+			}
+
+			void operator++( int ) { range->advance(); }
+
+			bool operator==( std::default_sentinel_t /* end */ ) const {
+				return range->current.node == nullptr;
+			}
+		};
+
+		iterator begin() {
+			if ( !started ) {
+				started = true;
+				advance();
+			}
+			return iterator( this );
+		}
+
+		std::default_sentinel_t end() const { return std::default_sentinel; }
+	};
+
+	/// Points in increasing distance from point under metric, for when the number wanted isn't
+	/// known up front, such as the nearest points passing a filter.
+	template <typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType> &&
+		( !kd_tree_metrics::IsPeriodic<Metric> )
+	IncrementalNeighbors<Metric> incremental_neighbors(
+		const CoordinatesType& point, const Metric& metric = Metric()
+	) const {
+		return { this, point, metric };
+	}
+
+	/// The number of nodes nearest_neighbors( point, k, metric ) visits on the original
+	/// coordinates, pruning with the subtree boxes or with only the split planes. For measuring
+	/// how much the boxes save on a dataset.
+	template <typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType>
+	std::size_t count_visited_nodes(
+		const CoordinatesType& point,
+		const std::size_t k,
+		const bool box_pruning = true,
+		const Metric& metric = Metric()
+	) const {
+		CountingCollector<KNearestCollector> collector = { { k, {} } };
+		Cell cell = root_cell( metric );
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			if ( box_pruning ) {
+				search<Dimensions, true>( root, 0, point, metric, collector, cell );
+			} else {
+				search<Dimensions, false>( root, 0, point, metric, collector, cell );
+			}
+		} );
+		return collector.visited;
+	}
+
+	/// Every point within radius of point under metric, in no particular order.
+	template <typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType>
+	std::vector<DataType*> within_radius(
+		const CoordinatesType& point, const DistanceType radius, const Metric& metric = Metric()
+	) const {
+		if constexpr ( !kd_tree_metrics::IsPeriodic<Metric> ) {
+			if ( !quantized_coordinates.empty() ) {
+				QuantizedRadiusCollector collector = { metric.to_reduced( radius ), {}, {} };
+				with_dimensions( [&]<std::size_t Dimensions>() {
+					Cell cell;
+					kd_tree_stats::QueryStats counts =
+						search_root<Dimensions, true>( point, metric, collector, cell );
+					counts.distance_evaluations += collector.candidates.size();
+					record( counts );
+					for ( DataType* candidate : collector.candidates ) {
+						if ( metric.template reduced_distance<Dimensions, DistanceType>(
+								 candidate->coordinates, point, dimensions
+							 ) <= collector.reduced_radius ) {
+							collector.found.push_back( candidate );
+						}
+					}
+				} );
+				return std::move( collector.found );
+			}
+		}
+		RadiusCollector collector = { metric.to_reduced( radius ), {} };
+		Cell cell = root_cell( metric );
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			record( search_root<Dimensions>( point, metric, collector, cell ) );
+		} );
+		return std::move( collector.found );
+	}
+
+	/// Every point with lower[dim] <= coordinates[dim] <= upper[dim] on every axis, in no
+	/// particular order.
+	std::vector<DataType*> in_box( const CoordinatesType& lower, const CoordinatesType& upper ) const {
+		std::vector<DataType*> found;
+		auto single = [&]( const Node* node ) { found.push_back( node->data ); };
+		auto whole = [&]( const Node* node ) { for_each_in_subtree( node, single ); };
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			box_range<Dimensions>( root, lower, upper, whole, single );
+		} );
+		return found;
+	}
+
+	/// The number of points in_box would return, adding up whole subtrees that lie inside the box
+	/// instead of visiting their points.
+	std::size_t count_in_box( const CoordinatesType& lower, const CoordinatesType& upper ) const {
+		std::size_t count = 0;
+		auto single = [&]( const Node* /* node */ ) { count++; };
+		auto whole = [&]( const Node* node ) { count += node->subtree_size; };
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			box_range<Dimensions>( root, lower, upper, whole, single );
+		} );
+		return count;
+	}
+
+	/// The number of points within_radius would return, adding up whole subtrees that lie inside
+	/// the radius instead of visiting their points.
+	template <typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType> &&
+		( !kd_tree_metrics::IsPeriodic<Metric> )
+	std::size_t count_within_radius(
+		const CoordinatesType& point, const DistanceType radius, const Metric& metric = Metric()
+	) const {
+		std::size_t count = 0;
+		auto single = [&]( const Node* /* node */ ) { count++; };
+		auto whole = [&]( const Node* node ) { count += node->subtree_size; };
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			radius_range<Dimensions>( root, point, metric.to_reduced( radius ), metric, whole, single );
+		} );
+		return count;
+	}
+
+	/// The Aggregate combined over every point in_box would return, taking whole subtrees inside
+	/// the box from their stored aggregate.
+	AggregateValue aggregate_in_box( const CoordinatesType& lower, const CoordinatesType& upper ) const
+		requires has_aggregate
+	{
+		AggregateValue total = aggregate.identity();
+		auto single = [&]( const Node* node ) {
+			total = aggregate.combine( total, aggregate.lift( *node->data ) );
+		};
+		auto whole = [&]( const Node* node ) {
+			total = aggregate.combine( total, subtree_aggregates[node_index( node )] );
+		};
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			box_range<Dimensions>( root, lower, upper, whole, single );
+		} );
+		return total;
+	}
+
+	/// The Aggregate combined over every point within_radius would return.
+	template <typename Metric = kd_tree_metrics::Euclidean>
+		requires has_aggregate && kd_tree_metrics::IsMetric<Metric, DistanceType> &&
+		( !kd_tree_metrics::IsPeriodic<Metric> )
+	AggregateValue aggregate_within_radius(
+		const CoordinatesType& point, const DistanceType radius, const Metric& metric = Metric()
+	) const {
+		AggregateValue total = aggregate.identity();
+		auto single = [&]( const Node* node ) {
+			total = aggregate.combine( total, aggregate.lift( *node->data ) );
+		};
+		auto whole = [&]( const Node* node ) {
+			total = aggregate.combine( total, subtree_aggregates[node_index( node )] );
+		};
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			radius_range<Dimensions>( root, point, metric.to_reduced( radius ), metric, whole, single );
+		} );
+		return total;
+	}
+
+	/// The mean kernel value kernel( distance / bandwidth ) between point and every point in the
+	/// tree, within relative_error of the exact mean. Subtrees whose nearest and furthest corners
+	/// give close enough kernel values are estimated from those bounds and their count instead of
+	/// being visited, a relative_error of 0 visits everything with a non-zero contribution.
+	/// Throws std::invalid_argument unless bandwidth is positive and relative_error isn't negative.
+	template <
+		typename Kernel = kd_tree_kernels::Gaussian,
+		typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType> &&
+		( !kd_tree_metrics::IsPeriodic<Metric> )
+	DistanceType kernel_density(
+		const CoordinatesType& point,
+		const DistanceType bandwidth,
+		const DistanceType relative_error = DistanceType( 0 ),
+		const Kernel& kernel = Kernel(),
+		const Metric& metric = Metric()
+	) const {
+		check_kernel_arguments( bandwidth, relative_error );
+		if ( root == nullptr ) {
+			return DistanceType( 0 );
+		}
+		DistanceType estimate = DistanceType( 0 );
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			DistanceType lower = static_cast<DistanceType>( nodes.size() ) *
+				kernel(
+					metric.to_distance( box_max_distance<Dimensions>(
+						metric, subtree_lower( root ), subtree_upper( root ), point, point
+					) ) /
+					bandwidth
+				);
+			kernel_sum<Dimensions>(
+				root, point, bandwidth, relative_error, kernel, metric, lower, estimate
+			);
+		} );
+		return estimate / static_cast<DistanceType>( nodes.size() );
+	}
+
+	/// kernel_density at each of points, evaluated in parallel. The arguments are checked once up
+	/// front, since nothing may throw out of the parallel evaluation.
+	template <
+		typename Kernel = kd_tree_kernels::Gaussian,
+		typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType> &&
+		( !kd_tree_metrics::IsPeriodic<Metric> )
+	std::vector<DistanceType> kernel_densities(
+		const std::vector<CoordinatesType>& points,
+		const DistanceType bandwidth,
+		const DistanceType relative_error = DistanceType( 0 ),
+		const Kernel& kernel = Kernel(),
+		const Metric& metric = Metric()
+	) const {
+		check_kernel_arguments( bandwidth, relative_error );
+		std::vector<DistanceType> densities( points.size() );
+		std::transform(
+			std::execution::par,
+			points.begin(),
+			points.end(),
+			densities.begin(),
+			[&]( const CoordinatesType& point ) {
+				return kernel_density( point, bandwidth, relative_error, kernel, metric );
+			}
+		);
+		return densities;
+	}
+
+	/// The k nearest other points of every point in the tree, as rows of k closest first and
+	/// padded with nullptr when the tree has k or fewer points. Row i belongs to the i-th point
+	/// added to the tree. Built with a dual-tree traversal run in parallel over query subtrees.
+	template <typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType> &&
+		( !kd_tree_metrics::IsPeriodic<Metric> )
+	std::vector<DataType*> all_nearest_neighbors( const std::size_t k, const Metric& metric = Metric() ) const {
+		NeighborGraph graph = {
+			k,
+			std::vector<Neighbor>( nodes.size() * k ),
+			std::vector<std::size_t>( nodes.size(), 0 ),
+			std::vector<DistanceType>( nodes.size(), std::numeric_limits<DistanceType>::max() )
+		};
+		std::vector<DataType*> neighbors( nodes.size() * k, nullptr );
+		if ( root == nullptr || k == 0 ) {
+			return neighbors;
+		}
+
+		// each subtree owns the candidate rows of its points
+		std::vector<const Node*> subtrees;
+		std::vector<const Node*> above;
+		collect_query_subtrees( root, 0, parallel_split_depth(), subtrees, above );
+
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			std::for_each( std::execution::par, above.begin(), above.end(), [&]( const Node* node ) {
+				GraphCollector collector = { &graph, node_index( node ), node->data };
+				Cell cell;
+				search<Dimensions>( root, 0, node->data->coordinates, metric, collector, cell );
+			} );
+			std::for_each( std::execution::par, subtrees.begin(), subtrees.end(), [&]( const Node* node ) {
+				dual_tree_neighbors<Dimensions>( node, root, 0, metric, graph );
+			} );
+		} );
+
+		std::for_each( std::execution::par, nodes.begin(), nodes.end(), [&]( const Node& node ) {
+			const std::size_t index = node_index( &node );
+			Neighbor* heap = graph.candidates.data() + ( index * k );
+			std::sort_heap( heap, heap + graph.counts[index] );
+			for ( std::size_t i = 0; i < graph.counts[index]; i++ ) {
+				neighbors[( index * k ) + i] = heap[i].data;
+			}
+		} );
+		return neighbors;
+	}
+
+	/// Calls callback( a, b ) for every point a in this tree and b in other within radius of each
+	/// other. The trees may hold different Input types but need the same dimensions. The work is
+	/// split over subtrees of this tree, so callback is called concurrently and must be thread
+	/// safe.
+	template <
+		typename OtherInput,
+		typename OtherWrappedInput,
+		typename OtherAggregate,
+		typename OtherSplitRule,
+		typename OtherStats,
+		typename Callback,
+		typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType> &&
+		( !kd_tree_metrics::IsPeriodic<Metric> )
+	void join_within_radius(
+		const KD_Tree<OtherInput, OtherWrappedInput, OtherAggregate, OtherSplitRule, OtherStats>&
+			other,
+		const DistanceType radius,
+		Callback callback,
+		const Metric& metric = Metric()
+	) const {
+		using OtherTree =
+			KD_Tree<OtherInput, OtherWrappedInput, OtherAggregate, OtherSplitRule, OtherStats>;
+		constexpr std::size_t join_dimensions =
+			static_dimensions != 0 ? static_dimensions : OtherTree::static_dimensions;
+		static_assert(
+			static_dimensions == 0 || OtherTree::static_dimensions == 0 ||
+				static_dimensions == OtherTree::static_dimensions,
+			"Joined trees need the same dimensions"
+		);
+		if ( root == nullptr || other.root == nullptr ) {
+			return;
+		}
+		if ( dimensions != other.dimensions ) {
+			throw std::invalid_argument( "Joined trees need the same dimensions" );
+		}
+
+		const DistanceType reduced_radius = metric.to_reduced( radius );
+		std::vector<const Node*> subtrees;
+		std::vector<const Node*> above;
+		const std::size_t split_depth = parallel_split_depth();
+		collect_query_subtrees( root, 0, split_depth, subtrees, above );
+
+		auto join = [&]<std::size_t Dimensions>() {
+			std::for_each( std::execution::par, above.begin(), above.end(), [&]( const Node* node ) {
+				auto emit = [&]( const typename OtherTree::Node* other_node ) {
+					callback( node->data, other_node->data );
+				};
+				EmitCollector<decltype( emit )> collector = { reduced_radius, emit };
+				typename OtherTree::Cell cell;
+				other.template search<Dimensions>(
+					other.root, 0, node->data->coordinates, metric, collector, cell
+				);
+			} );
+			std::for_each( std::execution::par, subtrees.begin(), subtrees.end(), [&]( const Node* node ) {
+				join_subtrees<Dimensions>(
+					node, split_depth, other, other.root, 0, reduced_radius, metric, callback
+				);
+			} );
+		};
+		if constexpr ( join_dimensions != 0 ) {
+			join.template operator()<join_dimensions>();
+		} else {
+			with_dimensions( join );
+		}
+	}
+
+	/// Calls callback( a, b ) once for every unordered pair of distinct points in this tree within
+	/// radius of each other. As with join_within_radius callback is called concurrently.
+	template <typename Callback, typename Metric = kd_tree_metrics::Euclidean>
+		requires kd_tree_metrics::IsMetric<Metric, DistanceType> &&
+		( !kd_tree_metrics::IsPeriodic<Metric> )
+	void self_join_within_radius(
+		const DistanceType radius, Callback callback, const Metric& metric = Metric()
+	) const {
+		if ( root == nullptr ) {
+			return;
+		}
+		const DistanceType reduced_radius = metric.to_reduced( radius );
+		std::vector<const Node*> subtrees;
+		std::vector<const Node*> above;
+		const std::size_t split_depth = parallel_split_depth();
+		collect_query_subtrees( root, 0, split_depth, subtrees, above );
+
+		// pairs with a point above the subtrees come from that point's search of the whole
+		// tree, ordered by node index when both are above
+		std::vector<std::uint8_t> is_above( nodes.size(), 0 );
+		for ( const Node* node : above ) {
+			is_above[node_index( node )] = 1;
+		}
+		std::vector<std::pair<std::size_t, std::size_t>> subtree_pairs;
+		for ( std::size_t i = 0; i < subtrees.size(); i++ ) {
+			for ( std::size_t j = i; j < subtrees.size(); j++ ) {
+				subtree_pairs.emplace_back( i, j );
+			}
+		}
+		with_dimensions( [&]<std::size_t Dimensions>() {
+			std::for_each( std::execution::par, above.begin(), above.end(), [&]( const Node* node ) {
+				auto emit = [&]( const Node* other_node ) {
+					if ( is_above[node_index( other_node )] == 0 ||
+						 node_index( other_node ) > node_index( node ) ) {
+						callback( node->data, other_node->data );
+					}
+				};
+				EmitCollector<decltype( emit )> collector = { reduced_radius, emit };
+				Cell cell;
+				search<Dimensions>( root, 0, node->data->coordinates, metric, collector, cell );
+			} );
+
+			// then pairs within one subtree and pairs across two of them
+			std::for_each(
+				std::execution::par,
+				subtree_pairs.begin(),
+				subtree_pairs.end(),
+				[&]( const std::pair<std::size_t, std::size_t>& pair ) {
+					const Node* first = subtrees[pair.first];
+					const Node* second = subtrees[pair.second];
+					if ( pair.first == pair.second ) {
+						self_join_subtree<Dimensions>(
+							first, split_depth, reduced_radius, metric, callback
+						);
+					} else {
+						join_subtrees<Dimensions>(
+							first,
+							split_depth,
+							*this,
+							second,
+							split_depth,
+							reduced_radius,
+							metric,
+							callback
+						);
+					}
+				}
+			);
+		} );
+	}
+};
+
+template<kd_tree_types::IsOwnableInput Input>
+KD_Tree(Input&& input_data) -> KD_Tree<Input, Input>;
+
+template<kd_tree_types::IsValidInput Input>
+KD_Tree(std::shared_ptr<Input> input_data) -> KD_Tree<Input, std::shared_ptr<Input>>;
+
+template<kd_tree_types::IsOwnableInput Input, typename Aggregate>
+KD_Tree(Input&& input_data, Aggregate aggregate) -> KD_Tree<Input, Input, Aggregate>;
+
+template<kd_tree_types::IsValidInput Input, typename Aggregate>
+KD_Tree(std::shared_ptr<Input> input_data, Aggregate aggregate) -> KD_Tree<Input, std::shared_ptr<Input>, Aggregate>;
+
+template<kd_tree_types::IsOwnableInput Input, typename Aggregate, typename SplitRule>
+KD_Tree(Input&& input_data, Aggregate aggregate, SplitRule split_rule) -> KD_Tree<Input, Input, Aggregate, SplitRule>;
+
+template<kd_tree_types::IsValidInput Input, typename Aggregate, typename SplitRule>
+KD_Tree(std::shared_ptr<Input> input_data, Aggregate aggregate, SplitRule split_rule) -> KD_Tree<Input, std::shared_ptr<Input>, Aggregate, SplitRule>;
+
+template<kd_tree_types::IsOwnableInput Input, typename Aggregate, typename SplitRule, typename Stats>
+KD_Tree(Input&& input_data, Aggregate aggregate, SplitRule split_rule, Stats stats) -> KD_Tree<Input, Input, Aggregate, SplitRule, Stats>;
+
+template<kd_tree_types::IsValidInput Input, typename Aggregate, typename SplitRule, typename Stats>
+KD_Tree(std::shared_ptr<Input> input_data, Aggregate aggregate, SplitRule split_rule, Stats stats) -> KD_Tree<Input, std::shared_ptr<Input>, Aggregate, SplitRule, Stats>;
 
 }  //  namespace spatial_lib
 
@@ -0,0 +1,226 @@
+////////////////////////////////////////////////////////////////////////////////
+/* Copyright (c) <2024> <Aidan Welch>
+
+Permission is hereby granted, free of charge, to any person (except as 
+specified below) obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without restriction, including 
+without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom 
+the Software is furnished to do so, subject to the following conditions:
+
+This permission IS NOT granted for use by or distribution to entities within
+any or all of the following categories:
+	- Annual Revenue in any year since 2020 exceeding $250,000 US Dollars.
+	- Government Entities
+	- Total funding from all government entities exceeding $10,000 US Dollars.
+	- Political Action Committees
+	- Received any funding from a Political Action Committee.
+
+Entities within these categories should contact the copyright holder for
+licensing at: aidan@freedwave.com
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software. The notice should be clearly
+accessible to end users.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SPATIAL_LIB_QUERY_SERVICE_HPP_
+#define SPATIAL_LIB_QUERY_SERVICE_HPP_
+
+#include "kd_tree.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace spatial_lib {
+
+/// Answers single queries submitted from any thread through futures, running them in micro
+/// batches. Each batch is sorted in Z order before it runs, so consecutive queries walk mostly
+/// the same nodes while they're still in cache. A worker flushes a batch once batch_size
+/// queries are waiting or the oldest has waited deadline, whichever comes first. The tree
+/// must outlive the service and not change while it runs.
+template <typename Tree, typename Metric = kd_tree_metrics::Euclidean>
+	requires kd_tree_metrics::IsMetric<Metric, typename Tree::DistanceType>
+class QueryService {
+	public:
+	using DataType = typename Tree::DataType;
+	using CoordinatesType = typename Tree::CoordinatesType;
+	using DistanceType = typename Tree::DistanceType;
+
+	/// threads of 0 uses one per hardware thread
+	explicit QueryService(
+		const Tree& queried_tree,
+		const std::size_t batch_size = 256,
+		const std::chrono::microseconds deadline = std::chrono::microseconds( 200 ),
+		std::size_t threads = 0,
+		Metric query_metric = Metric()
+	)
+		: tree( queried_tree ),
+		  metric( std::move( query_metric ) ),
+		  batch( std::max<std::size_t>( batch_size, 1 ) ),
+		  flush_after( deadline ) {
+		if ( threads == 0 ) {
+			threads = std::max<std::size_t>( 1, std::thread::hardware_concurrency() );
+		}
+		for ( std::size_t i = 0; i < threads; i++ ) {
+			workers.emplace_back( [this] { run_batches(); } );
+		}
+	}
+
+	QueryService( const QueryService& ) = delete;
+	QueryService& operator=( const QueryService& ) = delete;
+	QueryService( QueryService&& ) = delete;
+	QueryService& operator=( QueryService&& ) = delete;
+
+	/// Answers everything already submitted before returning
+	~QueryService() {
+		{
+			const std::lock_guard<std::mutex> lock( queue_mutex );
+			stopping = true;
+		}
+		has_requests.notify_all();
+		for ( std::thread& worker : workers ) {
+			worker.join();
+		}
+	}
+
+	std::future<DataType*> nearest_neighbor( const CoordinatesType& point ) {
+		return submit<NearestPromise>( point, 0, DistanceType( 0 ) );
+	}
+
+	std::future<std::vector<DataType*>> nearest_neighbors( const CoordinatesType& point, const std::size_t k ) {
+		return submit<NeighborsPromise>( point, k, DistanceType( 0 ) );
+	}
+
+	std::future<std::vector<DataType*>> within_radius( const CoordinatesType& point, const DistanceType radius ) {
+		return submit<RadiusPromise>( point, 0, radius );
+	}
+
+	private:
+	using Clock = std::chrono::steady_clock;
+
+	struct NearestPromise : std::promise<DataType*> {};
+	struct NeighborsPromise : std::promise<std::vector<DataType*>> {};
+	struct RadiusPromise : std::promise<std::vector<DataType*>> {};
+
+	struct Request {
+		CoordinatesType point;
+		std::size_t k;
+		DistanceType radius;
+		std::uint64_t code;
+		Clock::time_point arrival;
+		std::variant<NearestPromise, NeighborsPromise, RadiusPromise> answer;
+	};
+
+	const Tree& tree;
+	[[no_unique_address]] Metric metric;
+	std::size_t batch;
+	std::chrono::microseconds flush_after;
+
+	std::mutex queue_mutex;
+	std::condition_variable has_requests;
+	std::deque<Request> queue;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+
+	template <typename Promise>
+	auto submit( const CoordinatesType& point, const std::size_t k, const DistanceType radius ) {
+		Request request = { {}, k, radius, tree.morton_code( point ), Clock::now(), Promise() };
+		if constexpr ( std::is_array_v<CoordinatesType> ) {
+			std::copy( std::begin( point ), std::end( point ), std::begin( request.point ) );
+		} else {
+			request.point = point;
+		}
+		auto future = std::get<Promise>( request.answer ).get_future();
+		{
+			const std::lock_guard<std::mutex> lock( queue_mutex );
+			queue.push_back( std::move( request ) );
+		}
+		// an idle worker starts the deadline of what's queued, or flushes a full batch now
+		has_requests.notify_one();
+		return future;
+	}
+
+	void run_batches() {
+		std::unique_lock<std::mutex> lock( queue_mutex );
+		while ( true ) {
+			has_requests.wait( lock, [&] { return stopping || !queue.empty(); } );
+			if ( queue.empty() ) {
+				return;
+			}
+			if ( !stopping && queue.size() < batch ) {
+				has_requests.wait_until( lock, queue.front().arrival + flush_after, [&] {
+					return stopping || queue.size() >= batch;
+				} );
+				// another worker may have taken the batch whose deadline this was
+				if ( queue.empty() ||
+					 ( !stopping && queue.size() < batch && Clock::now() < queue.front().arrival + flush_after ) ) {
+					continue;
+				}
+			}
+			const std::size_t count = std::min( batch, queue.size() );
+			std::vector<Request> requests(
+				std::make_move_iterator( queue.begin() ),
+				std::make_move_iterator( queue.begin() + static_cast<std::ptrdiff_t>( count ) )
+			);
+			queue.erase( queue.begin(), queue.begin() + static_cast<std::ptrdiff_t>( count ) );
+			// the rest needs an idle worker to flush it or start its deadline while this one answers
+			if ( !queue.empty() ) {
+				has_requests.notify_one();
+			}
+			lock.unlock();
+			answer( requests );
+			lock.lock();
+		}
+	}
+
+	void answer( std::vector<Request>& requests ) const {
+		std::sort( requests.begin(), requests.end(), []( const Request& a, const Request& b ) {
+			return a.code < b.code;
+		} );
+		for ( Request& request : requests ) {
+			std::visit(
+				[&]<typename Promise>( Promise& promise ) {
+					try {
+						if constexpr ( std::is_same_v<Promise, NearestPromise> ) {
+							promise.set_value( tree.nearest_neighbor( request.point, metric ) );
+						} else if constexpr ( std::is_same_v<Promise, NeighborsPromise> ) {
+							promise.set_value( tree.nearest_neighbors( request.point, request.k, metric ) );
+						} else {
+							promise.set_value( tree.within_radius( request.point, request.radius, metric ) );
+						}
+					} catch ( ... ) {
+						promise.set_exception( std::current_exception() );
+					}
+				},
+				request.answer
+			);
+		}
+	}
+};
+
+}  // namespace spatial_lib
+
+#endif
\ No newline at end of file
@@ -1,19 +1,1504 @@
+#include "../clustering.hpp"
+#include "../concurrent_kd_tree.hpp"
+#include "../query_service.hpp"
 #include "../kd_tree.hpp"
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <future>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
 struct Value {
 	std::array<int, 4> coordinates;
 	int x;
 };
 
+struct Point3 {
+	std::array<double, 3> coordinates;
+	int id;
+};
+
+struct DynamicPoint {
+	std::vector<double> coordinates;
+	int id;
+};
+
+struct FloatPoint {
+	std::array<float, 3> coordinates;
+	int id;
+};
+
+namespace {
+
+int failures = 0;
+
+void check( const bool passed, const std::string& name ) {
+	if ( !passed ) {
+		failures++;
+		std::cout << "FAILED: " << name << '\n' << std::flush;
+	}
+}
+
+bool close( const double a, const double b ) {
+	return std::abs( a - b ) <= 1e-9 * std::max( 1.0, std::abs( a ) );
+}
+
+std::vector<Point3> random_points( const std::size_t count, const unsigned int seed ) {
+	std::mt19937 generator( seed );
+	std::uniform_real_distribution<double> distribution( -100.0, 100.0 );
+	std::vector<Point3> points;
+	for ( std::size_t i = 0; i < count; i++ ) {
+		points.push_back(
+			{ { distribution( generator ), distribution( generator ), distribution( generator ) },
+			  static_cast<int>( i ) }
+		);
+	}
+	return points;
+}
+
+/// Sorted distances from point to everything in points, the brute force reference
+template <typename Metric, typename T, typename P>
+std::vector<double> brute_force_distances(
+	const std::vector<T>& points, const P& point, const Metric& metric
+) {
+	std::vector<double> distances;
+	for ( const T& other : points ) {
+		distances.push_back(
+			metric.template distance<0, double>( other.coordinates, point, point.size() )
+		);
+	}
+	std::sort( distances.begin(), distances.end() );
+	return distances;
+}
+
+template <typename Tree, typename T, typename Metric>
+void check_queries(
+	const Tree& tree,
+	const std::vector<T>& points,
+	const Metric& metric,
+	const std::string& name
+) {
+	std::mt19937 generator( 7 );
+	std::uniform_real_distribution<double> distribution( -110.0, 110.0 );
+	for ( int query = 0; query < 50; query++ ) {
+		decltype( T::coordinates ) point = points[0].coordinates;
+		for ( double& coordinate : point ) {
+			coordinate = distribution( generator );
+		}
+		const std::vector<double> expected = brute_force_distances( points, point, metric );
+
+		const T* nearest = tree.nearest_neighbor( point, metric );
+		check(
+			nearest != nullptr &&
+				close(
+					metric.template distance<0, double>( nearest->coordinates, point, point.size() ),
+					expected[0]
+				),
+			name + " nearest_neighbor"
+		);
+
+		const std::vector<T*> neighbors = tree.nearest_neighbors( point, 10, metric );
+		bool neighbors_match = neighbors.size() == 10;
+		for ( std::size_t i = 0; neighbors_match && i < neighbors.size(); i++ ) {
+			neighbors_match = close(
+				metric.template distance<0, double>( neighbors[i]->coordinates, point, point.size() ),
+				expected[i]
+			);
+		}
+		check( neighbors_match, name + " nearest_neighbors" );
+		check( tree.nearest_neighbors( point, 0, metric ).empty(), name + " nearest_neighbors k 0" );
+
+		// halfway between two points so rounding can't move either across the radius
+		const double radius = ( expected[100] + expected[101] ) / 2;
+		check(
+			tree.within_radius( point, radius, metric ).size() == 101,
+			name + " within_radius"
+		);
+		if constexpr ( !spatial_lib::kd_tree_metrics::IsPeriodic<Metric> ) {
+			check(
+				tree.count_within_radius( point, radius, metric ) == 101,
+				name + " count_within_radius"
+			);
+		}
+	}
+}
+
+template <typename Tree, typename T>
+void check_all_metrics( const Tree& tree, const std::vector<T>& points, const std::string& name ) {
+	using namespace spatial_lib::kd_tree_metrics;
+	check_queries( tree, points, Euclidean(), name + " euclidean" );
+	check_queries( tree, points, Manhattan(), name + " manhattan" );
+	check_queries( tree, points, Chebyshev(), name + " chebyshev" );
+	check_queries( tree, points, Minkowski<3>(), name + " minkowski 3" );
+	check_queries(
+		tree,
+		points,
+		Weighted<Manhattan, std::array<double, 3>>( { 1.0, 4.0, 0.5 } ),
+		name + " weighted manhattan"
+	);
+}
+
+void test_metric_queries() {
+	const std::vector<Point3> points = random_points( 2000, 1 );
+	spatial_lib::KD_Tree static_tree( std::make_shared<std::vector<Point3>>( points ) );
+	check_all_metrics( static_tree, points, "static" );
+
+	std::vector<DynamicPoint> dynamic_points;
+	for ( const Point3& point : points ) {
+		dynamic_points.push_back(
+			{ { point.coordinates.begin(), point.coordinates.end() }, point.id }
+		);
+	}
+	spatial_lib::KD_Tree dynamic_tree( std::make_shared<std::vector<DynamicPoint>>( dynamic_points ) );
+	check_all_metrics( dynamic_tree, dynamic_points, "dynamic" );
+
+	// reranking on the original coordinates keeps quantized results exact
+	static_tree.quantize();
+	dynamic_tree.quantize();
+	check_all_metrics( static_tree, points, "quantized static" );
+	check_all_metrics( dynamic_tree, dynamic_points, "quantized dynamic" );
+
+	check(
+		static_tree.nearest_neighbor( points[42].coordinates )->id == 42, "exact nearest_neighbor"
+	);
+}
+
+/// The quantized copy of x steps by exactly 1 between the two end points, y and z don't vary
+void test_quantized_edges() {
+	using namespace spatial_lib::kd_tree_metrics;
+	const std::vector<Point3> points = {
+		{ { 0.0, 0.0, 0.0 }, 0 },
+		{ { 65535.0, 0.0, 0.0 }, 1 },
+		{ { 1000.5, 0.0, 0.0 }, 2 },
+		{ { 999.5, 0.0, 0.0 }, 3 },
+		{ { 1003.0, 0.0, 0.0 }, 4 },
+	};
+	spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point3>>( points ) );
+	tree.quantize();
+
+	// 2 rounds a step further out than 3 but is nearer, its lower bound within 0.002 of the
+	// upper bound of 3, so only the quantization slack keeps it among the candidates
+	const std::array<double, 3> query = { 1000.0 + ( 1.0 / 1024.0 ), 0.0, 0.0 };
+	check( tree.nearest_neighbor( query )->id == 2, "quantized nearest_neighbor at the cutoff" );
+	const std::vector<Point3*> neighbors = tree.nearest_neighbors( query, 2 );
+	check(
+		neighbors.size() == 2 && neighbors[0]->id == 2 && neighbors[1]->id == 3,
+		"quantized nearest_neighbors at the cutoff"
+	);
+
+	// a radius exactly the distance to 2, every distance here is exact in binary
+	const double radius = 0.5 - ( 1.0 / 1024.0 );
+	for ( const bool chebyshev : { false, true } ) {
+		const std::vector<Point3*> found = chebyshev
+			? tree.within_radius( query, radius, Chebyshev() )
+			: tree.within_radius( query, radius, Euclidean() );
+		check(
+			found.size() == 1 && found[0]->id == 2,
+			std::string( chebyshev ? "chebyshev" : "euclidean" ) +
+				" quantized within_radius at a point's distance"
+		);
+	}
+
+	// periodic metrics search the original coordinates, quantized or not
+	std::vector<Point3> periodic_points = random_points( 2000, 2 );
+	for ( Point3& point : periodic_points ) {
+		point.coordinates[0] += 100.0;
+		point.coordinates[1] += 100.0;
+	}
+	spatial_lib::KD_Tree periodic_tree( std::make_shared<std::vector<Point3>>( periodic_points ) );
+	periodic_tree.quantize();
+	check_queries(
+		periodic_tree,
+		periodic_points,
+		Periodic<Euclidean, std::array<double, 3>>( { 200.0, 200.0, 0.0 } ),
+		"quantized periodic euclidean"
+	);
+	const std::array<double, 3> near_edge = { 199.5, 100.0, 0.0 };
+	const Periodic<Euclidean, std::array<double, 3>> wrap( { 200.0, 200.0, 0.0 } );
+	const Point3* wrapped = periodic_tree.nearest_neighbor( near_edge, wrap );
+	double expected = std::numeric_limits<double>::max();
+	for ( const Point3& point : periodic_points ) {
+		expected = std::min( expected, wrap.distance<3, double>( point.coordinates, near_edge ) );
+	}
+	check(
+		close( wrap.distance<3, double>( wrapped->coordinates, near_edge ), expected ),
+		"quantized periodic wraps across the boundary"
+	);
+}
+
+/// Float data far from the origin, where a step is only ten ulps of the coordinates, so the
+/// rounding in dequantize adds to half a step. A point must still be found from itself.
+void test_quantized_far_floats() {
+	using spatial_lib::kd_tree_metrics::Euclidean;
+	std::mt19937 generator( 3 );
+	std::uniform_real_distribution<float> distribution( 1.0e6F, 1.0e6F + 40000.0F );
+	std::vector<FloatPoint> points;
+	for ( int i = 0; i < 2000; i++ ) {
+		points.push_back(
+			{ { distribution( generator ), distribution( generator ), distribution( generator ) }, i }
+		);
+	}
+	spatial_lib::KD_Tree tree( std::make_shared<std::vector<FloatPoint>>( points ) );
+	std::vector<std::vector<FloatPoint*>> nearest;
+	for ( const FloatPoint& point : points ) {
+		nearest.push_back( tree.nearest_neighbors( point.coordinates, 5 ) );
+	}
+
+	tree.quantize();
+	bool found_itself = true;
+	bool nearest_match = true;
+	for ( std::size_t i = 0; i < points.size(); i++ ) {
+		const std::vector<FloatPoint*> found = tree.within_radius( points[i].coordinates, 0.0F );
+		found_itself = found_itself &&
+			std::any_of( found.begin(), found.end(), [&]( const FloatPoint* point ) {
+				return point->id == points[i].id;
+			} );
+		const std::vector<FloatPoint*> neighbors = tree.nearest_neighbors( points[i].coordinates, 5 );
+		for ( std::size_t k = 0; k < neighbors.size(); k++ ) {
+			nearest_match = nearest_match &&
+				Euclidean().distance<3, float>( neighbors[k]->coordinates, points[i].coordinates ) <=
+					Euclidean().distance<3, float>( nearest[i][k]->coordinates, points[i].coordinates );
+		}
+	}
+	check( found_itself, "quantized far float within_radius finds the query point" );
+	check( nearest_match, "quantized far float nearest_neighbors" );
+}
+
+/// Runtime dimensions are dispatched to fixed size queries up to 16, and run with the runtime
+/// count above that
+void test_runtime_dimensions() {
+	using spatial_lib::kd_tree_metrics::Euclidean;
+	for ( const std::size_t dimensions : { std::size_t( 1 ), std::size_t( 7 ), std::size_t( 20 ) } ) {
+		const std::string name = "runtime dimensions " + std::to_string( dimensions );
+		std::mt19937 generator( 21 );
+		std::uniform_real_distribution<double> distribution( -100.0, 100.0 );
+		std::vector<DynamicPoint> points( 1000 );
+		for ( std::size_t i = 0; i < points.size(); i++ ) {
+			for ( std::size_t dim = 0; dim < dimensions; dim++ ) {
+				points[i].coordinates.push_back( distribution( generator ) );
+			}
+			points[i].id = static_cast<int>( i );
+		}
+		const spatial_lib::KD_Tree tree( std::make_shared<std::vector<DynamicPoint>>( points ) );
+
+		const std::vector<double> point = points[0].coordinates;
+		const std::vector<double> expected = brute_force_distances( points, point, Euclidean() );
+		const std::vector<DynamicPoint*> neighbors = tree.nearest_neighbors( point, 10 );
+		bool neighbors_match = neighbors.size() == 10;
+		for ( std::size_t i = 0; neighbors_match && i < neighbors.size(); i++ ) {
+			neighbors_match = close(
+				Euclidean().distance<0, double>( neighbors[i]->coordinates, point, dimensions ),
+				expected[i]
+			);
+		}
+		check( neighbors_match, name + " nearest_neighbors" );
+		const double radius = ( expected[50] + expected[51] ) / 2;
+		check( tree.within_radius( point, radius ).size() == 51, name + " within_radius" );
+
+		const std::vector<double> lower( dimensions, -60.0 );
+		const std::vector<double> upper( dimensions, 60.0 );
+		const std::size_t in_box = static_cast<std::size_t>(
+			std::count_if( points.begin(), points.end(), [&]( const DynamicPoint& other ) {
+				return std::all_of(
+					other.coordinates.begin(),
+					other.coordinates.end(),
+					[]( const double coordinate ) { return std::abs( coordinate ) <= 60.0; }
+				);
+			} )
+		);
+		check( tree.count_in_box( lower, upper ) == in_box, name + " count_in_box" );
+	}
+}
+
+/// Queries on a tree built with rule over points stretched 1000x along one axis
+template <typename SplitRule> void check_split_rule( const SplitRule& rule, const std::string& name ) {
+	std::vector<Point3> points = random_points( 2000, 12 );
+	for ( Point3& point : points ) {
+		point.coordinates[1] *= 1000.0;
+	}
+	spatial_lib::KD_Tree tree(
+		std::make_shared<std::vector<Point3>>( points ), spatial_lib::kd_tree_aggregates::None(), rule
+	);
+	check_all_metrics( tree, points, name );
+	check( tree.count_in_box( { -50, -5e4, -50 }, { 50, 5e4, 50 } ) ==
+			   static_cast<std::size_t>( std::count_if(
+				   points.begin(),
+				   points.end(),
+				   []( const Point3& point ) {
+					   return std::abs( point.coordinates[0] ) <= 50 &&
+						   std::abs( point.coordinates[1] ) <= 5e4 && std::abs( point.coordinates[2] ) <= 50;
+				   }
+			   ) ),
+		   name + " count_in_box" );
+
+	const spatial_lib::kd_tree_metrics::Euclidean metric;
+	const std::vector<Point3*> graph = tree.all_nearest_neighbors( 1 );
+	bool graph_matches = graph.size() == points.size();
+	for ( std::size_t i = 0; graph_matches && i < points.size(); i += 13 ) {
+		graph_matches = graph[i] != nullptr &&
+			close(
+				metric.distance<3, double>( points[i].coordinates, graph[i]->coordinates ),
+				brute_force_distances( points, points[i].coordinates, metric )[1]
+			);
+	}
+	check( graph_matches, name + " all_nearest_neighbors" );
+}
+
+void test_query_stats() {
+	using spatial_lib::kd_tree_stats::Counting;
+	using spatial_lib::kd_tree_stats::QueryStats;
+	const std::vector<Point3> points = random_points( 2000, 14 );
+	const Counting stats;
+	spatial_lib::KD_Tree counted(
+		std::make_shared<std::vector<Point3>>( points ),
+		spatial_lib::kd_tree_aggregates::None(),
+		spatial_lib::kd_tree_splits::CyclicMedian(),
+		stats
+	);
+	const spatial_lib::KD_Tree plain( std::make_shared<std::vector<Point3>>( points ) );
+
+	bool results_match = true;
+	bool evaluations_match = true;
+	bool counts_consistent = true;
+	QueryStats sum;
+	for ( std::size_t i = 0; i < 50; i++ ) {
+		const auto& point = points[i * 37].coordinates;
+		const std::vector<Point3*> neighbors = counted.nearest_neighbors( point, 10 );
+		const QueryStats last = Counting::last();
+		sum += last;
+		const std::vector<Point3*> expected = plain.nearest_neighbors( point, 10 );
+		results_match = results_match && neighbors.size() == expected.size() &&
+			std::equal( neighbors.begin(), neighbors.end(), expected.begin(), []( auto* a, auto* b ) {
+				return a->id == b->id;
+			} );
+		evaluations_match =
+			evaluations_match && last.distance_evaluations == plain.count_visited_nodes( point, 10 );
+		counts_consistent = counts_consistent && last.leaves_scanned > 0 &&
+			last.leaves_scanned <= last.distance_evaluations &&
+			last.distance_evaluations <= last.nodes_visited && last.pruned_subtrees > 0 &&
+			last.max_depth > 1 && last.max_depth <= 2 * counted.size();
+	}
+	check( results_match, "query stats leave results unchanged" );
+	check( evaluations_match, "query stats distance evaluations" );
+	check( counts_consistent, "query stats per query" );
+	const QueryStats total = stats.total();
+	check( stats.queries() == 50 && total.nodes_visited == sum.nodes_visited &&
+			   total.distance_evaluations == sum.distance_evaluations &&
+			   total.max_depth == sum.max_depth,
+		   "query stats totals" );
+
+	counted.quantize();
+	const auto& point = points[3].coordinates;
+	check( counted.within_radius( point, 20.0 ).size() == plain.within_radius( point, 20.0 ).size() &&
+			   stats.queries() == 51 &&
+			   Counting::last().distance_evaluations >= plain.within_radius( point, 20.0 ).size(),
+		   "query stats quantized" );
+	stats.reset();
+	check( stats.queries() == 0 && stats.total().nodes_visited == 0, "query stats reset" );
+}
+
+template <typename Metric> void check_batch_neighbors( const Metric& metric, const std::string& name ) {
+	using spatial_lib::kd_tree_stats::Counting;
+	const std::vector<Point3> points = random_points( 3000, 16 );
+	const Counting batch_stats;
+	const Counting single_stats;
+	// both trees over the same input, so their results are the same pointers
+	const auto data = std::make_shared<std::vector<Point3>>( points );
+	auto counted_tree = [&]( const Counting& stats ) {
+		return spatial_lib::KD_Tree(
+			data,
+			spatial_lib::kd_tree_aggregates::None(),
+			spatial_lib::kd_tree_splits::CyclicMedian(),
+			stats
+		);
+	};
+	const auto batch_tree = counted_tree( batch_stats );
+	const auto single_tree = counted_tree( single_stats );
+	const std::vector<Point3> queries = random_points( 200, 17 );
+	std::vector<std::array<double, 3>> coordinates;
+	for ( const Point3& query : queries ) {
+		coordinates.push_back( { query.coordinates[0], query.coordinates[1], query.coordinates[2] } );
+	}
+
+	for ( const std::size_t group : { std::size_t( 1 ), std::size_t( 7 ), std::size_t( 1000 ) } ) {
+		const std::vector<std::vector<Point3*>> batch =
+			batch_tree.nearest_neighbors_batch( coordinates, 10, metric, group );
+		bool matches = batch.size() == queries.size();
+		for ( std::size_t i = 0; matches && i < queries.size(); i++ ) {
+			matches = batch[i] == single_tree.nearest_neighbors( queries[i].coordinates, 10, metric );
+		}
+		check( matches, name + " batch neighbors in groups of " + std::to_string( group ) );
+	}
+	const auto batch_total = batch_stats.total();
+	const auto single_total = single_stats.total();
+	check( batch_stats.queries() == single_stats.queries() &&
+			   batch_total.nodes_visited == single_total.nodes_visited &&
+			   batch_total.distance_evaluations == single_total.distance_evaluations &&
+			   batch_total.pruned_subtrees == single_total.pruned_subtrees &&
+			   batch_total.max_depth == single_total.max_depth,
+		   name + " batch neighbors stats" );
+
+	check( batch_tree.nearest_neighbors_batch( std::vector<std::array<double, 3>>(), 10, metric ).empty() &&
+			   batch_tree.nearest_neighbors_batch( coordinates, 0, metric )[5].empty(),
+		   name + " batch neighbors edge cases" );
+
+	// a quantized tree answers each query with the quantized search, to the same neighbors
+	auto quantized_tree = counted_tree( batch_stats );
+	quantized_tree.quantize();
+	const std::vector<std::vector<Point3*>> quantized =
+		quantized_tree.nearest_neighbors_batch( coordinates, 10, metric );
+	bool matches = quantized.size() == queries.size();
+	for ( std::size_t i = 0; matches && i < queries.size(); i++ ) {
+		matches = quantized[i] == single_tree.nearest_neighbors( queries[i].coordinates, 10, metric );
+	}
+	check( matches && quantized_tree.nearest_neighbors_batch( coordinates, 0, metric )[5].empty(),
+		   name + " batch neighbors quantized" );
+}
+
+void test_build_report() {
+	const std::vector<Point3> points = random_points( 1000, 15 );
+	spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point3>>( points ) );
+	spatial_lib::kd_tree_types::BuildReport report = tree.build_report();
+
+	const auto& phases = report.phases;
+	check( phases.presort.size() == 3 &&
+			   phases.total >= phases.node_creation + phases.link + phases.summarize &&
+			   phases.total.count() > 0,
+		   "build report phases" );
+
+	const auto& shape = report.shape;
+	std::size_t counted = 0;
+	for ( const std::size_t nodes : shape.depth_histogram ) {
+		counted += nodes;
+	}
+	check( counted == points.size() && shape.depth_histogram[0] == 1 && shape.height == 10 &&
+			   close( shape.imbalance, 1.0 ) && shape.mean_depth > 7.0 && shape.mean_depth < 9.0,
+		   "build report shape" );
+
+	const std::size_t retained = report.memory.total();
+	check( report.memory.nodes > 0 && report.memory.presorted >= 3 * points.size() * sizeof( void* ) &&
+			   report.memory.subtree_bounds >= 6 * points.size() * sizeof( double ) &&
+			   report.memory.quantized == 0 && report.memory.link_scratch > 0,
+		   "build report memory" );
+	tree.quantize();
+	report = tree.build_report();
+	check( report.memory.quantized >= 3 * points.size() * sizeof( std::uint16_t ) &&
+			   report.memory.total() > retained,
+		   "build report quantized memory" );
+
+	const spatial_lib::KD_Tree empty( std::make_shared<std::vector<Point3>>() );
+	check( empty.build_report().shape.height == 0 && empty.build_report().shape.depth_histogram.empty(),
+		   "build report empty tree" );
+}
+
+void test_split_rules() {
+	using namespace spatial_lib::kd_tree_splits;
+	check_split_rule( CyclicMedian(), "cyclic median" );
+	check_split_rule( WidestSpread(), "widest spread" );
+	check_split_rule( SlidingMidpoint(), "sliding midpoint" );
+	check_split_rule( SlidingMidpoint{ 0.0 }, "sliding midpoint balance 0" );
+	check_split_rule( SlidingMidpoint{ 1.0 }, "sliding midpoint balance 1 clamped" );
+	check_split_rule( CostModel(), "cost model" );
+
+	const spatial_lib::KD_Tree median_slides(
+		std::make_shared<std::vector<Point3>>( random_points( 1000, 15 ) ),
+		spatial_lib::kd_tree_aggregates::None(),
+		SlidingMidpoint{ 0.0 }
+	);
+	check(
+		close( median_slides.build_report().shape.imbalance, 1.0 ),
+		"sliding midpoint balance 0 splits at the median"
+	);
+
+	// every midpoint falls between the last two points, so unclamped slides would peel one off
+	// each level and the height would reach the point count
+	std::vector<Point3> doubling;
+	for ( int i = 0; i < 1000; i++ ) {
+		doubling.push_back( { { std::pow( 2.0, i ), 0.0, 0.0 }, i } );
+	}
+	const spatial_lib::KD_Tree greedy_slides(
+		std::make_shared<std::vector<Point3>>( doubling ),
+		spatial_lib::kd_tree_aggregates::None(),
+		SlidingMidpoint{ 1.0 }
+	);
+	check( greedy_slides.build_report().shape.height < 150, "sliding midpoint depth stays logarithmic" );
+}
+
+/// Every subtree's point sits at its node index in the input once it's in tree order
+template <typename Subtree> bool indices_match( const Subtree subtree, const Point3* first ) {
+	return !subtree ||
+		( &subtree.point() - first == static_cast<std::ptrdiff_t>( subtree.index() ) &&
+		  indices_match( subtree.left(), first ) && indices_match( subtree.right(), first ) );
+}
+
+void test_reorder_input() {
+	const std::vector<Point3> points = random_points( 2000, 14 );
+
+	std::vector<Point3> owned = points;
+	spatial_lib::KD_Tree tree_order( std::move( owned ), spatial_lib::kd_tree_aggregates::Count() );
+	tree_order.quantize();
+	tree_order.reorder_input();
+	check_all_metrics( tree_order, points, "tree order" );
+	check( tree_order.aggregate_in_box( { -50, -50, -50 }, { 50, 50, 50 } ) ==
+			   tree_order.count_in_box( { -50, -50, -50 }, { 50, 50, 50 } ),
+		   "tree order aggregates" );
+	check(
+		indices_match( tree_order.root_subtree(), &tree_order.root_subtree().point() ),
+		"tree order data follows node index"
+	);
+
+	std::vector<Point3> morton_owned = points;
+	spatial_lib::KD_Tree morton_order( std::move( morton_owned ) );
+	morton_order.reorder_input( spatial_lib::kd_tree_types::InputOrder::morton );
+	check_all_metrics( morton_order, points, "morton order" );
+
+	// points added by generate_tree live outside the input, so there's nothing to move them into
+	std::vector<Point3> grown_owned = points;
+	std::vector<Point3> extra = random_points( 100, 15 );
+	spatial_lib::KD_Tree grown( std::move( grown_owned ) );
+	grown.generate_tree( &extra );
+	bool refused = false;
+	try {
+		grown.reorder_input();
+	} catch ( const std::logic_error& ) {
+		refused = true;
+	}
+	check( refused, "reorder_input refuses points outside the input" );
+}
+
+/// A moved tree takes the owned input's allocation along, so its nodes still point into it
+void test_move_owning_tree() {
+	using OwningTree = spatial_lib::KD_Tree<std::vector<Point3>, std::vector<Point3>>;
+	using ArrayInput = std::array<Point3, 4>;
+	static_assert(
+		!std::is_constructible_v<spatial_lib::KD_Tree<ArrayInput, ArrayInput>, ArrayInput&&>,
+		"inline storage can't be owned"
+	);
+	const std::vector<Point3> points = random_points( 2000, 18 );
+
+	std::vector<Point3> owned = points;
+	std::optional<OwningTree> source( std::in_place, std::move( owned ) );
+	source->quantize();
+	OwningTree moved( std::move( *source ) );
+	source.reset();
+	check_all_metrics( moved, points, "moved owning tree" );
+
+	std::vector<Point3> assigned_owned = points;
+	OwningTree assigned( std::vector<Point3>( points.begin(), points.begin() + 10 ) );
+	assigned = OwningTree( std::move( assigned_owned ) );
+	check_all_metrics( assigned, points, "move assigned owning tree" );
+}
+
+/// A single axis gets the whole code, so Z order is the order along it
+void test_morton_one_dimension() {
+	std::mt19937 generator( 16 );
+	std::uniform_real_distribution<double> distribution( -100.0, 100.0 );
+	std::vector<DynamicPoint> points;
+	for ( std::size_t i = 0; i < 1000; i++ ) {
+		points.push_back( { { distribution( generator ) }, static_cast<int>( i ) } );
+	}
+	std::vector<DynamicPoint> owned = points;
+	spatial_lib::KD_Tree tree( std::move( owned ) );
+
+	std::vector<double> along;
+	for ( const DynamicPoint& point : points ) {
+		along.push_back( point.coordinates[0] );
+	}
+	std::sort( along.begin(), along.end() );
+	bool codes_ordered = tree.morton_code( std::vector<double>{ along.front() } ) <
+		tree.morton_code( std::vector<double>{ along.back() } );
+	for ( std::size_t i = 1; codes_ordered && i < along.size(); i++ ) {
+		codes_ordered = tree.morton_code( std::vector<double>{ along[i - 1] } ) <=
+			tree.morton_code( std::vector<double>{ along[i] } );
+	}
+	check( codes_ordered, "1-D morton_code follows the axis" );
+	check(
+		tree.morton_code( std::vector<double>{ 1000.0 } ) ==
+			tree.morton_code( std::vector<double>{ along.back() } ),
+		"1-D morton_code clamps to the tree's box"
+	);
+
+	// an empty dynamic tree has no dimensions, and points without coordinates can't be added
+	spatial_lib::KD_Tree no_axes( std::vector<DynamicPoint>{} );
+	bool refused = false;
+	std::vector<DynamicPoint> empty_points = { { {}, 0 }, { {}, 1 } };
+	try {
+		no_axes.generate_tree( &empty_points );
+	} catch ( const std::invalid_argument& ) {
+		refused = true;
+	}
+	check(
+		refused && no_axes.size() == 0 && no_axes.morton_code( std::vector<double>() ) == 0,
+		"0-D morton_code and points without coordinates"
+	);
+
+	tree.reorder_input( spatial_lib::kd_tree_types::InputOrder::morton );
+	// by address, which is the input's order
+	std::vector<DynamicPoint*> stored = tree.within_radius( { 0.0 }, 1000.0 );
+	std::sort( stored.begin(), stored.end() );
+	check(
+		stored.size() == points.size() &&
+			std::is_sorted(
+				stored.begin(),
+				stored.end(),
+				[]( const DynamicPoint* a, const DynamicPoint* b ) {
+					return a->coordinates[0] < b->coordinates[0];
+				}
+			),
+		"1-D morton order sorts the input"
+	);
+	bool nearest_match = true;
+	for ( std::size_t i = 0; nearest_match && i < 50; i++ ) {
+		const std::vector<double> query = { distribution( generator ) };
+		const double expected = brute_force_distances(
+			points, query, spatial_lib::kd_tree_metrics::Euclidean()
+		)[0];
+		nearest_match =
+			close( std::abs( tree.nearest_neighbor( query )->coordinates[0] - query[0] ), expected );
+	}
+	check( nearest_match, "1-D morton order nearest_neighbor" );
+}
+
+void test_box_queries() {
+	const std::vector<Point3> points = random_points( 3000, 6 );
+	spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point3>>( points ) );
+	std::mt19937 generator( 8 );
+	std::uniform_real_distribution<double> distribution( -120.0, 120.0 );
+	for ( int query = 0; query < 100; query++ ) {
+		std::array<double, 3> lower;
+		std::array<double, 3> upper;
+		for ( std::size_t dim = 0; dim < 3; dim++ ) {
+			const double a = distribution( generator );
+			const double b = distribution( generator );
+			lower[dim] = std::min( a, b );
+			upper[dim] = std::max( a, b );
+		}
+		std::vector<int> expected;
+		for ( const Point3& point : points ) {
+			bool inside = true;
+			for ( std::size_t dim = 0; dim < 3; dim++ ) {
+				inside = inside && lower[dim] <= point.coordinates[dim] &&
+					point.coordinates[dim] <= upper[dim];
+			}
+			if ( inside ) {
+				expected.push_back( point.id );
+			}
+		}
+		std::vector<int> found;
+		for ( const Point3* point : tree.in_box( lower, upper ) ) {
+			found.push_back( point->id );
+		}
+		std::sort( found.begin(), found.end() );
+		check( found == expected, "in_box" );
+		check( tree.count_in_box( lower, upper ) == expected.size(), "count_in_box" );
+	}
+}
+
+/// Box pruning only adds to the split-plane test, so it can never visit more nodes
+template <typename Metric> void check_box_pruning( const Metric& metric, const std::string& name ) {
+	const std::vector<Point3> points = random_points( 5000, 12 );
+	spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point3>>( points ) );
+	std::mt19937 generator( 13 );
+	std::uniform_real_distribution<double> distribution( -120.0, 120.0 );
+	bool never_more = true;
+	std::size_t with_boxes = 0;
+	std::size_t with_planes = 0;
+	for ( int query = 0; query < 100; query++ ) {
+		const std::array<double, 3> point = {
+			distribution( generator ), distribution( generator ), distribution( generator )
+		};
+		const std::size_t boxes = tree.count_visited_nodes( point, 10, true, metric );
+		const std::size_t planes = tree.count_visited_nodes( point, 10, false, metric );
+		never_more = never_more && boxes <= planes;
+		with_boxes += boxes;
+		with_planes += planes;
+	}
+	check( never_more, name + " box pruning visits no more nodes" );
+	check( with_boxes < with_planes, name + " box pruning visits fewer nodes overall" );
+}
+
+void test_aggregates() {
+	using namespace spatial_lib::kd_tree_aggregates;
+	const std::vector<Point3> points = random_points( 3000, 9 );
+	auto id = []( const Point3& point ) { return point.id; };
+	spatial_lib::KD_Tree sum_tree(
+		std::make_shared<std::vector<Point3>>( points ), Sum<decltype( id )>()
+	);
+	spatial_lib::KD_Tree min_tree(
+		std::make_shared<std::vector<Point3>>( points ), Min<decltype( id )>()
+	);
+	spatial_lib::KD_Tree count_tree( std::make_shared<std::vector<Point3>>( points ), Count() );
+	const spatial_lib::kd_tree_metrics::Euclidean metric;
+
+	std::mt19937 generator( 10 );
+	std::uniform_real_distribution<double> distribution( -120.0, 120.0 );
+	for ( int query = 0; query < 100; query++ ) {
+		const std::array<double, 3> center = {
+			distribution( generator ), distribution( generator ), distribution( generator )
+		};
+		const double radius = std::abs( distribution( generator ) );
+		const std::array<double, 3> lower = { center[0] - radius, center[1] - radius, center[2] - radius };
+		const std::array<double, 3> upper = { center[0] + radius, center[1] + radius, center[2] + radius };
+
+		double box_sum = 0;
+		double box_min = std::numeric_limits<double>::max();
+		double radius_sum = 0;
+		std::size_t radius_count = 0;
+		for ( const Point3& point : points ) {
+			bool inside = true;
+			for ( std::size_t dim = 0; dim < 3; dim++ ) {
+				inside = inside && lower[dim] <= point.coordinates[dim] &&
+					point.coordinates[dim] <= upper[dim];
+			}
+			if ( inside ) {
+				box_sum += point.id;
+				box_min = std::min( box_min, static_cast<double>( point.id ) );
+			}
+			if ( metric.distance<3, double>( point.coordinates, center ) <= radius ) {
+				radius_sum += point.id;
+				radius_count++;
+			}
+		}
+		check( close( sum_tree.aggregate_in_box( lower, upper ), box_sum ), "aggregate_in_box sum" );
+		check( close( min_tree.aggregate_in_box( lower, upper ), box_min ), "aggregate_in_box min" );
+		check(
+			close( sum_tree.aggregate_within_radius( center, radius ), radius_sum ),
+			"aggregate_within_radius sum"
+		);
+		check(
+			count_tree.aggregate_within_radius( center, radius ) == radius_count,
+			"aggregate_within_radius count"
+		);
+	}
+}
+
+template <typename Kernel> void check_kernel_density( const std::string& name ) {
+	const std::vector<Point3> points = random_points( 4000, 11 );
+	spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point3>>( points ) );
+	const spatial_lib::kd_tree_metrics::Euclidean metric;
+	const Kernel kernel;
+	const double bandwidth = 15.0;
+
+	std::vector<std::array<double, 3>> queries;
+	for ( std::size_t i = 0; i < 40; i++ ) {
+		queries.push_back( points[i * 50].coordinates );
+		queries.back()[0] += 3.0;
+	}
+	const std::vector<double> approximate = tree.kernel_densities( queries, bandwidth, 0.05, kernel );
+	for ( std::size_t i = 0; i < queries.size(); i++ ) {
+		double expected = 0;
+		for ( const Point3& point : points ) {
+			expected += kernel( metric.distance<3, double>( point.coordinates, queries[i] ) / bandwidth );
+		}
+		expected /= static_cast<double>( points.size() );
+		check(
+			std::abs( tree.kernel_density( queries[i], bandwidth, 0.0, kernel ) - expected ) <=
+				1e-9 * expected,
+			name + " exact kernel_density"
+		);
+		check(
+			std::abs( approximate[i] - expected ) <= 0.05 * expected,
+			name + " approximate kernel_densities"
+		);
+	}
+
+	std::size_t refused = 0;
+	for ( const auto& [bad_bandwidth, bad_error] :
+		  { std::pair( 0.0, 0.0 ), std::pair( -1.0, 0.0 ), std::pair( bandwidth, -0.1 ) } ) {
+		try {
+			tree.kernel_density( queries[0], bad_bandwidth, bad_error, kernel );
+		} catch ( const std::invalid_argument& ) {
+			refused++;
+		}
+		try {
+			tree.kernel_densities( queries, bad_bandwidth, bad_error, kernel );
+		} catch ( const std::invalid_argument& ) {
+			refused++;
+		}
+	}
+	check( refused == 6, name + " kernel_density refuses bad bandwidths and errors" );
+}
+
+void test_dbscan() {
+	const std::vector<Point3> points = random_points( 2000, 17 );
+	const spatial_lib::kd_tree_metrics::Euclidean metric;
+	const double radius = 9.0;
+	const std::size_t min_points = 4;
+	const std::vector<std::size_t> labels = spatial_lib::dbscan(
+		std::make_shared<std::vector<Point3>>( points ), radius, min_points
+	);
+
+	// brute force core points and their clusters, border points may join any neighbouring cluster
+	std::vector<std::vector<std::size_t>> neighbors( points.size() );
+	for ( std::size_t i = 0; i < points.size(); i++ ) {
+		for ( std::size_t j = 0; j < points.size(); j++ ) {
+			if ( metric.distance<3, double>( points[i].coordinates, points[j].coordinates ) <= radius ) {
+				neighbors[i].push_back( j );
+			}
+		}
+	}
+	std::vector<std::size_t> expected( points.size(), spatial_lib::dbscan_noise );
+	std::size_t clusters = 0;
+	for ( std::size_t i = 0; i < points.size(); i++ ) {
+		if ( neighbors[i].size() < min_points || expected[i] != spatial_lib::dbscan_noise ) {
+			continue;
+		}
+		std::vector<std::size_t> stack = { i };
+		expected[i] = clusters;
+		while ( !stack.empty() ) {
+			const std::size_t current = stack.back();
+			stack.pop_back();
+			for ( const std::size_t neighbor : neighbors[current] ) {
+				if ( neighbors[neighbor].size() >= min_points && expected[neighbor] == spatial_lib::dbscan_noise ) {
+					expected[neighbor] = clusters;
+					stack.push_back( neighbor );
+				}
+			}
+		}
+		clusters++;
+	}
+	check( clusters > 10, "dbscan finds several clusters" );
+
+	std::vector<std::size_t> label_of_cluster( clusters, spatial_lib::dbscan_noise );
+	bool matches = labels.size() == points.size();
+	for ( std::size_t i = 0; matches && i < points.size(); i++ ) {
+		if ( expected[i] != spatial_lib::dbscan_noise ) {
+			if ( label_of_cluster[expected[i]] == spatial_lib::dbscan_noise ) {
+				label_of_cluster[expected[i]] = labels[i];
+			}
+			matches = labels[i] == label_of_cluster[expected[i]];
+		}
+	}
+	std::sort( label_of_cluster.begin(), label_of_cluster.end() );
+	matches = matches &&
+		std::adjacent_find( label_of_cluster.begin(), label_of_cluster.end() ) == label_of_cluster.end();
+	for ( std::size_t i = 0; matches && i < points.size(); i++ ) {
+		if ( expected[i] == spatial_lib::dbscan_noise ) {
+			bool border = false;
+			bool joined_neighbor = false;
+			for ( const std::size_t neighbor : neighbors[i] ) {
+				border = border || expected[neighbor] != spatial_lib::dbscan_noise;
+				joined_neighbor = joined_neighbor ||
+					( expected[neighbor] != spatial_lib::dbscan_noise && labels[neighbor] == labels[i] );
+			}
+			matches = border ? joined_neighbor : labels[i] == spatial_lib::dbscan_noise;
+		}
+	}
+	check( matches, "dbscan" );
+}
+
+void test_kmeans() {
+	// well separated blobs around random centers
+	const std::vector<Point3> blob_centers = random_points( 12, 23 );
+	std::mt19937 generator( 29 );
+	std::normal_distribution<double> spread( 0.0, 4.0 );
+	std::vector<Point3> points;
+	for ( std::size_t i = 0; i < 6000; i++ ) {
+		Point3 point = blob_centers[i % blob_centers.size()];
+		for ( double& coordinate : point.coordinates ) {
+			coordinate += spread( generator );
+		}
+		point.id = static_cast<int>( i );
+		points.push_back( point );
+	}
+
+	std::vector<std::array<double, 3>> initial;
+	for ( std::size_t i = 0; i < 12; i++ ) {
+		initial.push_back( points[i * 37].coordinates );
+	}
+	const auto result =
+		spatial_lib::kmeans( std::make_shared<std::vector<Point3>>( points ), initial, 50 );
+
+	// brute force Lloyd's from the same centers
+	std::vector<std::array<double, 3>> expected = initial;
+	std::vector<std::size_t> expected_labels( points.size() );
+	for ( std::size_t iteration = 0; iteration < result.iterations; iteration++ ) {
+		std::vector<std::array<double, 3>> sums( expected.size(), { 0, 0, 0 } );
+		std::vector<std::size_t> counts( expected.size(), 0 );
+		for ( std::size_t i = 0; i < points.size(); i++ ) {
+			std::size_t nearest = 0;
+			for ( std::size_t center = 1; center < expected.size(); center++ ) {
+				if ( spatial_lib::kd_tree_metrics::Euclidean().reduced_distance<3, double>(
+						 points[i].coordinates, expected[center]
+					 ) <
+					 spatial_lib::kd_tree_metrics::Euclidean().reduced_distance<3, double>(
+						 points[i].coordinates, expected[nearest]
+					 ) ) {
+					nearest = center;
+				}
+			}
+			expected_labels[i] = nearest;
+			counts[nearest]++;
+			for ( std::size_t dim = 0; dim < 3; dim++ ) {
+				sums[nearest][dim] += points[i].coordinates[dim];
+			}
+		}
+		for ( std::size_t center = 0; center < expected.size(); center++ ) {
+			for ( std::size_t dim = 0; counts[center] != 0 && dim < 3; dim++ ) {
+				expected[center][dim] = sums[center][dim] / static_cast<double>( counts[center] );
+			}
+		}
+	}
+
+	check( result.iterations > 1 && result.iterations < 50, "kmeans converges" );
+	bool centers_match = result.centers.size() == expected.size();
+	for ( std::size_t center = 0; centers_match && center < expected.size(); center++ ) {
+		for ( std::size_t dim = 0; dim < 3; dim++ ) {
+			centers_match = centers_match &&
+				std::abs( result.centers[center][dim] - expected[center][dim] ) < 1e-6;
+		}
+	}
+	check( centers_match, "kmeans centers" );
+	check( result.labels == expected_labels, "kmeans labels" );
+
+	const auto seeded = spatial_lib::kmeans( std::make_shared<std::vector<Point3>>( points ), 12 );
+	check( seeded.centers.size() == 12 && seeded.labels.size() == points.size(), "kmeans seeded" );
+}
+
+/// Total length of the minimum spanning tree by Prim's algorithm over every pair
+template <typename Edge> double brute_force_mst_length( const std::size_t count, const Edge& edge ) {
+	std::vector<double> distance( count, std::numeric_limits<double>::max() );
+	std::vector<std::uint8_t> in_tree( count, 0 );
+	distance[0] = 0;
+	double total = 0;
+	for ( std::size_t step = 0; step < count; step++ ) {
+		std::size_t next = count;
+		for ( std::size_t i = 0; i < count; i++ ) {
+			if ( in_tree[i] == 0 && ( next == count || distance[i] < distance[next] ) ) {
+				next = i;
+			}
+		}
+		in_tree[next] = 1;
+		total += distance[next];
+		for ( std::size_t i = 0; i < count; i++ ) {
+			if ( in_tree[i] == 0 ) {
+				distance[i] = std::min( distance[i], edge( next, i ) );
+			}
+		}
+	}
+	return total;
+}
+
+template <typename Edges> bool spans( const Edges& edges, const std::size_t count ) {
+	std::vector<std::size_t> parent( count );
+	for ( std::size_t i = 0; i < count; i++ ) {
+		parent[i] = i;
+	}
+	auto find = [&]( std::size_t node ) {
+		while ( parent[node] != node ) {
+			node = parent[node];
+		}
+		return node;
+	};
+	for ( const auto& edge : edges ) {
+		if ( find( edge.a ) == find( edge.b ) ) {
+			return false;
+		}
+		parent[find( edge.a )] = find( edge.b );
+	}
+	return edges.size() + 1 == count;
+}
+
+void test_spanning_trees() {
+	const spatial_lib::kd_tree_metrics::Euclidean metric;
+	const std::vector<Point3> points = random_points( 1500, 31 );
+	auto distance = [&]( const std::size_t a, const std::size_t b ) {
+		return metric.distance<3, double>( points[a].coordinates, points[b].coordinates );
+	};
+	const auto edges = spatial_lib::euclidean_mst( std::make_shared<std::vector<Point3>>( points ) );
+	double length = 0;
+	for ( const spatial_lib::SpanningEdge& edge : edges ) {
+		length += edge.distance;
+	}
+	check( spans( edges, points.size() ), "euclidean_mst spans" );
+	check(
+		std::abs( length - brute_force_mst_length( points.size(), distance ) ) < 1e-6 * length,
+		"euclidean_mst length"
+	);
+
+	// blobs in uniform noise
+	std::vector<Point3> clustered = random_points( 300, 37 );
+	const std::vector<Point3> blob_centers = random_points( 4, 41 );
+	std::mt19937 generator( 43 );
+	std::normal_distribution<double> spread( 0.0, 3.0 );
+	for ( std::size_t i = 0; i < 1200; i++ ) {
+		Point3 point = blob_centers[i % blob_centers.size()];
+		for ( double& coordinate : point.coordinates ) {
+			coordinate += spread( generator );
+		}
+		clustered.push_back( point );
+	}
+	const std::size_t min_samples = 5;
+	const spatial_lib::HDBSCANResult result =
+		spatial_lib::hdbscan( std::make_shared<std::vector<Point3>>( clustered ), 20, min_samples );
+
+	std::vector<double> core( clustered.size() );
+	for ( std::size_t i = 0; i < clustered.size(); i++ ) {
+		core[i] = brute_force_distances( clustered, clustered[i].coordinates, metric )[min_samples - 1];
+	}
+	double reachability_length = 0;
+	for ( const spatial_lib::SpanningEdge& edge : result.spanning_tree ) {
+		reachability_length += edge.distance;
+	}
+	const double expected_length = brute_force_mst_length(
+		clustered.size(),
+		[&]( const std::size_t a, const std::size_t b ) {
+			return std::max(
+				{ metric.distance<3, double>( clustered[a].coordinates, clustered[b].coordinates ),
+				  core[a],
+				  core[b] }
+			);
+		}
+	);
+	check( spans( result.spanning_tree, clustered.size() ), "hdbscan spanning tree spans" );
+	check(
+		std::abs( reachability_length - expected_length ) < 1e-6 * expected_length,
+		"hdbscan mutual reachability length"
+	);
+
+	// every blob is one cluster of its own, and most of the background is noise
+	std::vector<std::size_t> blob_labels( blob_centers.size(), spatial_lib::hdbscan_noise );
+	std::size_t blob_misses = 0;
+	for ( std::size_t i = 300; i < clustered.size(); i++ ) {
+		std::size_t& label = blob_labels[( i - 300 ) % blob_centers.size()];
+		if ( label == spatial_lib::hdbscan_noise ) {
+			label = result.labels[i];
+		}
+		blob_misses += result.labels[i] != label ? 1U : 0U;
+	}
+	std::sort( blob_labels.begin(), blob_labels.end() );
+	check(
+		blob_labels.back() != spatial_lib::hdbscan_noise &&
+			std::adjacent_find( blob_labels.begin(), blob_labels.end() ) == blob_labels.end(),
+		"hdbscan separates blobs"
+	);
+	check( blob_misses < 60, "hdbscan keeps blobs together" );
+	std::size_t background_noise = 0;
+	for ( std::size_t i = 0; i < 300; i++ ) {
+		background_noise += result.labels[i] == spatial_lib::hdbscan_noise ? 1U : 0U;
+	}
+	check( background_noise > 200, "hdbscan leaves background as noise" );
+
+	// a minimum cluster size of 0 counts as 1, so core distances still have a neighbour
+	const std::vector<Point3> few = random_points( 50, 24 );
+	const spatial_lib::HDBSCANResult smallest =
+		spatial_lib::hdbscan( std::make_shared<std::vector<Point3>>( few ), 0 );
+	check(
+		smallest.labels.size() == few.size() && spans( smallest.spanning_tree, few.size() ),
+		"hdbscan min_cluster_size 0"
+	);
+}
+
+template <typename Metric> void check_incremental_neighbors( const Metric& metric, const std::string& name ) {
+	const std::vector<Point3> points = random_points( 2000, 40 );
+	const spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point3>>( points ) );
+	const std::array<double, 3> point = { 10.0, -20.0, 30.0 };
+	const std::vector<double> expected = brute_force_distances( points, point, metric );
+
+	// browsing every point gives them all in order
+	auto neighbors = tree.incremental_neighbors( point, metric );
+	std::size_t count = 0;
+	bool ordered = true;
+	for ( auto neighbor = neighbors.begin(); neighbor != neighbors.end(); ++neighbor ) {
+		ordered = ordered && count < expected.size() &&
+			close( metric.template distance<0, double>( ( *neighbor )->coordinates, point, 3 ), expected[count] ) &&
+			close( neighbor.distance(), expected[count] );
+		count++;
+	}
+	check( ordered && count == points.size(), name + " incremental_neighbors" );
+
+	// the nearest points passing a filter, without guessing k
+	std::vector<double> filtered;
+	for ( const Point3& other : points ) {
+		if ( other.id % 7 == 0 ) {
+			filtered.push_back( metric.template distance<0, double>( other.coordinates, point, 3 ) );
+		}
+	}
+	std::sort( filtered.begin(), filtered.end() );
+	std::size_t matched = 0;
+	for ( const Point3* neighbor : tree.incremental_neighbors( point, metric ) |
+			 std::views::filter( []( const Point3* other ) { return other->id % 7 == 0; } ) |
+			 std::views::take( 5 ) ) {
+		if ( close( metric.template distance<0, double>( neighbor->coordinates, point, 3 ), filtered[matched] ) ) {
+			matched++;
+		}
+	}
+	check( matched == 5, name + " filtered incremental_neighbors" );
+}
+
+void test_periodic_queries() {
+	using namespace spatial_lib::kd_tree_metrics;
+	std::vector<Point3> points = random_points( 2000, 2 );
+	for ( Point3& point : points ) {
+		point.coordinates[0] += 100.0;
+		point.coordinates[1] += 100.0;
+	}
+	spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point3>>( points ) );
+	check_queries(
+		tree,
+		points,
+		Periodic<Euclidean, std::array<double, 3>>( { 200.0, 200.0, 0.0 } ),
+		"periodic euclidean"
+	);
+	check_queries(
+		tree,
+		points,
+		Periodic<Chebyshev, std::array<double, 3>>( { 200.0, 200.0, 0.0 } ),
+		"periodic chebyshev"
+	);
+	const Weighted<Periodic<Euclidean, std::array<double, 3>>, std::array<double, 3>> weighted_wrap(
+		{ 1.0, 4.0, 0.5 }, Periodic<Euclidean, std::array<double, 3>>( { 200.0, 200.0, 0.0 } )
+	);
+	check_queries( tree, points, weighted_wrap, "weighted periodic euclidean" );
+
+	spatial_lib::KD_Tree small_tree( std::make_shared<std::vector<Point3>>( std::vector<Point3>(
+		{ { { 1.0, 100.0, 0.0 }, 0 }, { { 100.0, 100.0, 0.0 }, 1 }, { { 190.0, 100.0, 0.0 }, 2 } }
+	) ) );
+	const std::array<double, 3> near_edge = { 199.0, 100.0, 0.0 };
+	check(
+		small_tree.nearest_neighbor(
+			near_edge, Periodic<Euclidean, std::array<double, 3>>( { 200.0, 200.0, 0.0 } )
+		)->id == 0 &&
+			small_tree.nearest_neighbor( near_edge )->id == 2,
+		"periodic wraps across the boundary"
+	);
+	check(
+		small_tree.nearest_neighbor( near_edge, weighted_wrap )->id == 0,
+		"weighted periodic wraps across the boundary"
+	);
+}
+
+template <typename Metric> void check_all_nearest_neighbors( const Metric& metric, const std::string& name ) {
+	const std::vector<Point3> points = random_points( 3000, 3 );
+	spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point3>>( points ) );
+	const std::size_t k = 6;
+	const std::vector<Point3*> graph = tree.all_nearest_neighbors( k, metric );
+	bool rows_match = graph.size() == points.size() * k;
+	for ( std::size_t i = 0; rows_match && i < points.size(); i++ ) {
+		std::vector<double> expected;
+		for ( std::size_t j = 0; j < points.size(); j++ ) {
+			if ( j != i ) {
+				expected.push_back( metric.template distance<3, double>(
+					points[i].coordinates, points[j].coordinates
+				) );
+			}
+		}
+		std::sort( expected.begin(), expected.end() );
+		for ( std::size_t j = 0; rows_match && j < k; j++ ) {
+			const Point3* neighbor = graph[( i * k ) + j];
+			rows_match = neighbor != nullptr && neighbor->id != static_cast<int>( i ) &&
+				close(
+					metric.template distance<3, double>(
+						points[i].coordinates, neighbor->coordinates
+					),
+					expected[j]
+				);
+		}
+	}
+	check( rows_match, name + " all_nearest_neighbors" );
+}
+
+void test_all_nearest_neighbors() {
+	using namespace spatial_lib::kd_tree_metrics;
+	check_all_nearest_neighbors( Euclidean(), "euclidean" );
+	check_all_nearest_neighbors( Manhattan(), "manhattan" );
+
+	spatial_lib::KD_Tree pair( std::make_shared<std::vector<Point3>>(
+		std::vector<Point3>( { { { 0.0, 0.0, 0.0 }, 0 }, { { 1.0, 0.0, 0.0 }, 1 } } )
+	) );
+	const std::vector<Point3*> padded = pair.all_nearest_neighbors( 3 );
+	check(
+		padded.size() == 6 && padded[0]->id == 1 && padded[1] == nullptr && padded[3]->id == 0,
+		"all_nearest_neighbors pads small trees"
+	);
+}
+
+void test_radius_joins() {
+	using Pair = std::pair<int, int>;
+	const std::vector<Point3> points = random_points( 1500, 4 );
+	std::vector<DynamicPoint> others;
+	for ( const Point3& point : random_points( 1200, 5 ) ) {
+		others.push_back( { { point.coordinates.begin(), point.coordinates.end() }, point.id } );
+	}
+	spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point3>>( points ) );
+	spatial_lib::KD_Tree other_tree( std::make_shared<std::vector<DynamicPoint>>( others ) );
+	const spatial_lib::kd_tree_metrics::Euclidean metric;
+
+	for ( const double radius : { 4.0, 15.0, 400.0 } ) {
+		std::vector<Pair> expected;
+		std::vector<Pair> expected_self;
+		for ( const Point3& a : points ) {
+			for ( const DynamicPoint& b : others ) {
+				if ( metric.distance<3, double>( a.coordinates, b.coordinates ) <= radius ) {
+					expected.emplace_back( a.id, b.id );
+				}
+			}
+			for ( const Point3& b : points ) {
+				if ( a.id < b.id &&
+					 metric.distance<3, double>( a.coordinates, b.coordinates ) <= radius ) {
+					expected_self.emplace_back( a.id, b.id );
+				}
+			}
+		}
+
+		std::mutex lock;
+		std::vector<Pair> joined;
+		tree.join_within_radius( other_tree, radius, [&]( const Point3* a, const DynamicPoint* b ) {
+			const std::lock_guard<std::mutex> guard( lock );
+			joined.emplace_back( a->id, b->id );
+		} );
+		std::vector<Pair> self_joined;
+		tree.self_join_within_radius( radius, [&]( const Point3* a, const Point3* b ) {
+			const std::lock_guard<std::mutex> guard( lock );
+			self_joined.emplace_back( std::min( a->id, b->id ), std::max( a->id, b->id ) );
+		} );
+
+		std::sort( expected.begin(), expected.end() );
+		std::sort( expected_self.begin(), expected_self.end() );
+		std::sort( joined.begin(), joined.end() );
+		std::sort( self_joined.begin(), self_joined.end() );
+		check( joined == expected, "join_within_radius " + std::to_string( radius ) );
+		check( self_joined == expected_self, "self_join_within_radius " + std::to_string( radius ) );
+	}
+}
+
+/// Points tagged with their version in id
+std::vector<Point3> versioned_points( const int version ) {
+	std::vector<Point3> points = random_points( 2000, static_cast<unsigned int>( 100 + version ) );
+	for ( Point3& point : points ) {
+		point.id = version;
+	}
+	return points;
+}
+
+void test_concurrent_rebuilds() {
+	spatial_lib::ConcurrentKD_Tree tree( versioned_points( 0 ) );
+	constexpr int versions = 10;
+
+	// every snapshot has to see exactly one whole version
+	std::atomic<bool> done = false;
+	std::atomic<int> torn = 0;
+	std::vector<std::thread> readers;
+	for ( int reader = 0; reader < 3; reader++ ) {
+		readers.emplace_back( [&] {
+			while ( !done.load() ) {
+				const auto snapshot = tree.snapshot();
+				const std::vector<Point3*> neighbors = snapshot->nearest_neighbors( { 0.0, 0.0, 0.0 }, 20 );
+				for ( const Point3* neighbor : neighbors ) {
+					if ( neighbors.size() != 20 || neighbor->id != neighbors.front()->id ) {
+						torn++;
+					}
+				}
+			}
+		} );
+	}
+	for ( int version = 1; version <= versions; version++ ) {
+		tree.rebuild( versioned_points( version ) );
+	}
+	tree.wait();
+	done = true;
+	for ( std::thread& reader : readers ) {
+		reader.join();
+	}
+	check( torn == 0, "concurrent snapshots" );
+	check( tree.snapshot()->nearest_neighbor( { 0.0, 0.0, 0.0 } )->id == versions, "concurrent rebuild" );
+
+	// a held snapshot keeps its version alive after it's been replaced
+	const auto held = tree.snapshot();
+	const Point3* before = held->nearest_neighbor( { 0.0, 0.0, 0.0 } );
+	tree.rebuild( versioned_points( versions + 1 ) );
+	while ( tree.snapshot()->nearest_neighbor( { 0.0, 0.0, 0.0 } )->id != versions + 1 ) {
+		std::this_thread::yield();
+	}
+	check(
+		held->nearest_neighbor( { 0.0, 0.0, 0.0 } ) == before && before->id == versions,
+		"concurrent held snapshot"
+	);
+}
+
+void test_concurrent_inserts() {
+	// a small threshold so the inserts go through several merges
+	spatial_lib::ConcurrentKD_Tree tree(
+		random_points( 500, 30 ), spatial_lib::kd_tree_aggregates::None(), spatial_lib::kd_tree_splits::CyclicMedian(), 100
+	);
+	const std::vector<Point3> inserted = random_points( 4000, 31 );
+	std::vector<std::thread> writers;
+	for ( std::size_t writer = 0; writer < 4; writer++ ) {
+		writers.emplace_back( [&, writer] {
+			for ( std::size_t i = writer; i < inserted.size(); i += 4 ) {
+				Point3 point = inserted[i];
+				point.id += 1000;
+				tree.insert( point );
+			}
+		} );
+	}
+	for ( std::thread& writer : writers ) {
+		writer.join();
+	}
+
+	std::vector<Point3> points = random_points( 500, 30 );
+	for ( Point3 point : inserted ) {
+		point.id += 1000;
+		points.push_back( point );
+	}
+	// buffered points are searched by brute force until they're merged
+	auto check_snapshot = [&]( const std::string& name ) {
+		const auto snapshot = tree.snapshot();
+		check( snapshot.size() == 4500, name + " size" );
+		bool neighbors_match = true;
+		for ( const Point3& point : random_points( 20, 32 ) ) {
+			const std::vector<double> expected =
+				brute_force_distances( points, point.coordinates, spatial_lib::kd_tree_metrics::Euclidean() );
+			const std::vector<Point3*> neighbors = snapshot.nearest_neighbors( point.coordinates, 5 );
+			for ( std::size_t i = 0; i < 5; i++ ) {
+				neighbors_match = neighbors_match &&
+					close( spatial_lib::kd_tree_metrics::Euclidean().distance<0, double>(
+							   neighbors[i]->coordinates, point.coordinates, 3
+						   ),
+						   expected[i] );
+			}
+		}
+		check( neighbors_match, name + " nearest_neighbors" );
+	};
+	check_snapshot( "concurrent inserts" );
+	tree.wait();
+	check_snapshot( "concurrent inserts merged" );
+	check( tree.snapshot()->size() == 4500, "concurrent inserts merged into tree" );
+
+	// a held Snapshot stalls the merge, so the buffer grows past the threshold meanwhile
+	{
+		const auto snapshot = tree.snapshot();
+		for ( const Point3& point : random_points( 1000, 33 ) ) {
+			tree.insert( point );
+		}
+		check( tree.snapshot().size() == 5500, "inserts buffered while a snapshot holds the merge" );
+	}
+	tree.wait();
+	check( tree.snapshot()->size() == 5500, "inserts merge once the snapshot is released" );
+
+	// many threads that each stay well under a segment still add up to a merge
+	spatial_lib::ConcurrentKD_Tree shared(
+		random_points( 500, 34 ), spatial_lib::kd_tree_aggregates::None(), spatial_lib::kd_tree_splits::CyclicMedian(), 1000
+	);
+	writers.clear();
+	for ( std::size_t writer = 0; writer < 64; writer++ ) {
+		writers.emplace_back( [&, writer] {
+			for ( const Point3& point : random_points( 20, 35 + writer ) ) {
+				shared.insert( point );
+			}
+		} );
+	}
+	for ( std::thread& writer : writers ) {
+		writer.join();
+	}
+	shared.wait();
+	check( shared.snapshot().size() == 1780, "small inserts from many threads all buffered" );
+	check( shared.snapshot()->size() >= 1500, "small inserts from many threads merge" );
+}
+
+void test_query_service() {
+	const std::vector<Point3> points = random_points( 2000, 50 );
+	const spatial_lib::KD_Tree tree( std::make_shared<std::vector<Point3>>( points ) );
+	const std::vector<Point3> queries = random_points( 400, 51 );
+
+	// batches fill from several submitting threads and get answered out of order
+	std::atomic<int> mismatches = 0;
+	{
+		spatial_lib::QueryService service( tree, 16, std::chrono::microseconds( 500 ), 2 );
+		std::vector<std::thread> clients;
+		for ( std::size_t client = 0; client < 4; client++ ) {
+			clients.emplace_back( [&, client] {
+				std::vector<std::future<Point3*>> nearest;
+				std::vector<std::future<std::vector<Point3*>>> neighbors;
+				std::vector<std::future<std::vector<Point3*>>> within;
+				for ( std::size_t i = client; i < queries.size(); i += 4 ) {
+					nearest.push_back( service.nearest_neighbor( queries[i].coordinates ) );
+					neighbors.push_back( service.nearest_neighbors( queries[i].coordinates, 5 ) );
+					within.push_back( service.within_radius( queries[i].coordinates, 15.0 ) );
+				}
+				for ( std::size_t i = client, j = 0; i < queries.size(); i += 4, j++ ) {
+					if ( nearest[j].get() != tree.nearest_neighbor( queries[i].coordinates ) ||
+						 neighbors[j].get() != tree.nearest_neighbors( queries[i].coordinates, 5 ) ||
+						 within[j].get().size() != tree.within_radius( queries[i].coordinates, 15.0 ).size() ) {
+						mismatches++;
+					}
+				}
+			} );
+		}
+		for ( std::thread& client : clients ) {
+			client.join();
+		}
+	}
+	check( mismatches == 0, "query service answers" );
+
+	// a lone query is flushed by the deadline instead of waiting for a full batch
+	spatial_lib::QueryService service( tree, 64, std::chrono::microseconds( 100 ), 1 );
+	std::future<Point3*> lone = service.nearest_neighbor( points[7].coordinates );
+	check(
+		lone.wait_for( std::chrono::seconds( 5 ) ) == std::future_status::ready && lone.get()->id == 7,
+		"query service deadline"
+	);
+}
+
+}  // namespace
+
 int main() {
 	std::cout << "Hello World\n" << std::flush;
 	std::shared_ptr<std::vector<Value>> smart_data = std::make_shared<std::vector<Value>>();
 	auto smart_tree = spatial_lib::KD_Tree(smart_data);
 	std::vector<Value> value_data;
 	auto value_tree = spatial_lib::KD_Tree(std::move(value_data));
-	return 0;
-}
\ No newline at end of file
+	check( value_tree.nearest_neighbor( { 1, 2, 3, 4 } ) == nullptr, "empty nearest_neighbor" );
+
+	test_metric_queries();
+	test_quantized_edges();
+	test_quantized_far_floats();
+	test_runtime_dimensions();
+	test_box_queries();
+	check_box_pruning( spatial_lib::kd_tree_metrics::Euclidean(), "euclidean" );
+	check_box_pruning( spatial_lib::kd_tree_metrics::Manhattan(), "manhattan" );
+	test_aggregates();
+	check_kernel_density<spatial_lib::kd_tree_kernels::Gaussian>( "gaussian" );
+	check_kernel_density<spatial_lib::kd_tree_kernels::Epanechnikov>( "epanechnikov" );
+	test_dbscan();
+	test_kmeans();
+	test_split_rules();
+	test_query_stats();
+	test_build_report();
+	check_batch_neighbors( spatial_lib::kd_tree_metrics::Euclidean(), "euclidean" );
+	check_batch_neighbors( spatial_lib::kd_tree_metrics::Manhattan(), "manhattan" );
+	test_reorder_input();
+	test_move_owning_tree();
+	test_morton_one_dimension();
+	test_spanning_trees();
+	check_incremental_neighbors( spatial_lib::kd_tree_metrics::Euclidean(), "euclidean" );
+	check_incremental_neighbors( spatial_lib::kd_tree_metrics::Manhattan(), "manhattan" );
+	test_periodic_queries();
+	test_all_nearest_neighbors();
+	test_radius_joins();
+	test_concurrent_rebuilds();
+	test_concurrent_inserts();
+	test_query_service();
+
+	return failures == 0 ? 0 : 1;
+}
+
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)